@@ -0,0 +1,124 @@
+//Auto-tuning of the CORRECTION quality levels and threshold. The threshold is the one CONTROL carries, which afu.v
+//compares with the 2-bit compressed qualities; the Bloom filter's own threshold is tied to 0 in
+//bloom_filter_wrapper.sv and can't be tuned. A reservoir sample of the input reads that carry a quality string is
+//corrected with every setting in autotune_settings; for each one the candidates per read, device time per read
+//and fraction of reads that get corrected are measured. The cheapest setting (device time per read) whose
+//corrected fraction reaches the target wins. The target is absolute if given, otherwise a fraction of the best
+//corrected fraction seen. Reads without qualities would all look the same to every setting, so they aren't sampled.
+
+//Levels are raw quality bytes as compressQualityScore.v compares them - the first table is the historic default,
+//the others are Phred+33 bands of increasing width
+static const struct correction_setting autotune_settings[] = {
+    {1, {0, 20, 60, 80}}, {2, {0, 20, 60, 80}}, {3, {0, 20, 60, 80}},
+    {1, {33, 43, 53, 63}}, {2, {33, 43, 53, 63}}, {3, {33, 43, 53, 63}},
+    {1, {33, 48, 58, 68}}, {2, {33, 48, 58, 68}}, {3, {33, 48, 58, 68}}
+};
+
+//Reservoir sample (algorithm R) of the first AUTOTUNE_SCAN_READS reads of the stimulus range, packed as
+//correction items. A fixed seed keeps the sample, and so the chosen setting, reproducible.
+uint32_t sample_correction_reads(const std::string& stimulus_file_name, const struct run_checkpoint* checkpoint, const struct host_kernels* kernels, char* sample_space, uint32_t capacity) {
+    std::ifstream input(stimulus_file_name.c_str(), std::ios::binary);
+    std::string read_string, read_token, quality;
+    uint64_t random_state = 0x9e3779b97f4a7c15ull;
+    uint32_t num_reads = 0, num_without_quality = 0;
+
+    input.seekg(checkpoint->input_offset);
+    while ((num_reads < AUTOTUNE_SCAN_READS) && ((uint64_t) input.tellg() < checkpoint->input_end) && std::getline(input, read_string)) {
+        int32_t start_position, end_position;
+        if (!parse_stimulus_line(read_string, &read_token, &start_position, &end_position, &quality)) continue;
+        int32_t this_read_length = std::min((int32_t) read_token.length(), kernels->read_length);
+        if (this_read_length < kernels->kmer_length) continue;
+        if (quality.empty()) {
+            num_without_quality++;
+            continue;
+        }
+
+        uint32_t slot = num_reads;
+        if (num_reads >= capacity) {
+            random_state ^= random_state << 13;
+            random_state ^= random_state >> 7;
+            random_state ^= random_state << 17;
+            slot = (uint32_t) (random_state % (num_reads + 1));
+        }
+        num_reads++;
+        if (slot >= capacity) continue;
+
+        char* read_item = sample_space + (uint64_t) slot * 512;
+        kernels->pack_read(read_item, read_token.c_str(), quality.c_str(), this_read_length);
+        read_item[254] = start_position;
+        read_item[253] = end_position;
+    }
+    if ((num_reads == 0) && (num_without_quality > 0)) {
+        std::cout << "WARNING! No stimulus line carries a quality string - auto-tune needs 'read start end quality' lines" << std::endl;
+    }
+    return std::min(num_reads, capacity);
+}
+
+int32_t autotune_correction(fenome::accelerator* accelerator, const struct host_kernels* kernels, const char* sample_space, uint32_t num_reads, double target_fraction, struct correction_setting* chosen) {
+    const uint32_t num_settings = sizeof(autotune_settings) / sizeof(autotune_settings[0]);
+    struct autotune_result results[sizeof(autotune_settings) / sizeof(autotune_settings[0])];
+    char* candidate_space = (char*) accelerator->allocate_buffer((uint64_t) num_reads * 256 * 32);
+    double best_fraction = 0;
+
+    if (!candidate_space || (num_reads == 0)) {
+        std::cout << "WARNING! Nothing to auto-tune on, keeping the default levels" << std::endl;
+        fenome::accelerator::release_buffer(candidate_space);
+        return -1;
+    }
+
+    for (uint32_t s = 0; s < num_settings; s++) {
+        fenome::batch batch;
+        batch.mode        = fenome::afu_mode::correction;
+        batch.num_items   = num_reads;
+        batch.read_space  = (char*) sample_space;
+        batch.write_space = candidate_space;
+        batch.threshold   = autotune_settings[s].threshold;
+        memcpy(batch.levels, autotune_settings[s].levels, sizeof(batch.levels));
+        fenome::batch_result result = accelerator->submit(batch).get();
+        if (!result.success) {
+            fenome::accelerator::release_buffer(candidate_space);
+            return -1;
+        }
+
+        uint64_t num_candidates = 0, num_corrected = 0;
+        for (uint32_t m = 0; m < num_reads; m++) {
+            const char* read_item = sample_space + (uint64_t) m * 512;
+            const char* candidate_local_space = candidate_space + (uint64_t) m * 256 * 32;
+            int32_t read_length = (uint8_t) read_item[255];
+            int32_t best_candidate = choose_candidate(candidate_local_space, read_item, read_length, kernels);
+            num_candidates += std::min((int32_t) (uint8_t) candidate_local_space[255], 32);
+            num_corrected  += (best_candidate >= 0) && (kernels->count_differences(candidate_local_space + best_candidate * 256, read_item, read_length) > 0);
+        }
+        results[s].candidates_per_read = (double) num_candidates / num_reads;
+        results[s].device_ns_per_read  = (double) result.device_ns / num_reads;
+        results[s].corrected_fraction  = (double) num_corrected / num_reads;
+        best_fraction = std::max(best_fraction, results[s].corrected_fraction);
+    }
+    fenome::accelerator::release_buffer(candidate_space);
+
+    double target = (target_fraction > 0) ? target_fraction : AUTOTUNE_RELATIVE_TARGET * best_fraction;
+    int32_t chosen_setting = -1;
+    for (uint32_t s = 0; s < num_settings; s++) {
+        const struct correction_setting* setting = &autotune_settings[s];
+        std::cout << "Auto-tune threshold " << (int32_t) setting->threshold << " levels " << (int32_t) setting->levels[0] << "/" << (int32_t) setting->levels[1] << "/"
+                  << (int32_t) setting->levels[2] << "/" << (int32_t) setting->levels[3] << " : " << results[s].candidates_per_read << " candidates/read, "
+                  << results[s].device_ns_per_read / 1000 << " us/read, " << 100 * results[s].corrected_fraction << "% corrected" << std::endl;
+        if ((best_fraction == 0) || (results[s].corrected_fraction < target)) continue;
+        if ((chosen_setting < 0) || (results[s].device_ns_per_read < results[chosen_setting].device_ns_per_read) ||
+            ((results[s].device_ns_per_read == results[chosen_setting].device_ns_per_read) && (results[s].candidates_per_read < results[chosen_setting].candidates_per_read))) {
+            chosen_setting = s;
+        }
+    }
+    if (best_fraction == 0) {
+        std::cout << "WARNING! No setting corrected a sampled read, keeping the default levels" << std::endl;
+        return -1;
+    }
+    if (chosen_setting < 0) {
+        std::cout << "WARNING! No setting corrects " << 100 * target << "% of the sample, keeping the default levels" << std::endl;
+        return -1;
+    }
+    *chosen = autotune_settings[chosen_setting];
+    std::cout << "Auto-tune picked threshold " << (int32_t) chosen->threshold << " levels " << (int32_t) chosen->levels[0] << "/" << (int32_t) chosen->levels[1] << "/"
+              << (int32_t) chosen->levels[2] << "/" << (int32_t) chosen->levels[3] << " on " << num_reads << " sampled reads" << std::endl;
+    return chosen_setting;
+}
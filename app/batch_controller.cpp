@@ -0,0 +1,84 @@
+//Adaptive batch sizing. Each controller hill-climbs the number of items per Start: it measures the throughput
+//(items per second of host + device time) over a window of batches at one size, keeps moving in the same
+//direction while throughput improves and turns around with a smaller step when it doesn't.
+//Sizes are always multiples of the AFU's item granularity and bounded by the memory budget, which has to cover
+//every per-item buffer. Buffers are sized for the current batch and grown as the controller grows it.
+#include <math.h>
+
+static uint32_t batch_controller_round(struct batch_controller* controller, double items) {
+    uint32_t rounded = ((uint32_t) items / controller->granularity) * controller->granularity;
+    if (rounded < controller->min_items) rounded = controller->min_items;
+    if (rounded > controller->max_items) rounded = controller->max_items;
+    return rounded;
+}
+
+void batch_controller_init(struct batch_controller* controller, const char* name, uint32_t initial_items, uint32_t min_items, uint32_t granularity, uint64_t bytes_per_item, uint64_t memory_budget) {
+    uint64_t max_items = memory_budget / bytes_per_item;
+
+    controller->name        = name;
+    controller->granularity = granularity;
+    controller->min_items   = ((min_items + granularity - 1) / granularity) * granularity;
+    controller->max_items   = (uint32_t) ((max_items / granularity) * granularity);
+    if (controller->max_items < controller->min_items) {
+        std::cout << "WARNING! Memory budget too small for " << name << " batches, using " << controller->min_items << " items" << std::endl;
+        controller->max_items = controller->min_items;
+    }
+    controller->current           = batch_controller_round(controller, initial_items);
+    controller->step              = BATCH_CONTROLLER_INITIAL_STEP;
+    controller->direction         = 1;
+    controller->last_throughput   = 0;
+    controller->window_batches    = 0;
+    controller->window_items      = 0;
+    controller->window_ns         = 0;
+}
+
+uint32_t inline batch_controller_size(struct batch_controller* controller) {
+    return controller->current;
+}
+
+uint32_t inline batch_controller_capacity(struct batch_controller* controller) {
+    return controller->max_items;
+}
+
+char* batch_buffer_reserve(fenome::accelerator* accelerator, char* space, uint32_t* capacity, uint32_t num_items, uint64_t bytes_per_item) {
+    if (space && (num_items <= *capacity)) return space;
+    fenome::accelerator::release_buffer(space);
+    space = (char*) accelerator->allocate_buffer((uint64_t) num_items * bytes_per_item);
+    *capacity = space ? num_items : 0;
+    return space;
+}
+
+void batch_controller_update(struct batch_controller* controller, uint32_t num_items, uint64_t host_ns, uint64_t device_ns) {
+    //Short batches (the tail of the input) say nothing about the current size
+    if (num_items != controller->current) return;
+
+    controller->window_batches++;
+    controller->window_items += num_items;
+    controller->window_ns    += host_ns + device_ns;
+    if (controller->window_batches < BATCH_CONTROLLER_WINDOW || controller->window_ns == 0) return;
+
+    double throughput = controller->window_items * 1e9 / controller->window_ns;
+    controller->window_batches = 0;
+    controller->window_items   = 0;
+    controller->window_ns      = 0;
+
+    //Turn around with a finer step when the last move didn't pay off
+    if ((controller->last_throughput > 0) && (throughput < controller->last_throughput * (1 + BATCH_CONTROLLER_TOLERANCE))) {
+        controller->direction = -controller->direction;
+        controller->step      = 1 + (controller->step - 1) / 2;
+        if (controller->step < BATCH_CONTROLLER_MIN_STEP) controller->step = BATCH_CONTROLLER_MIN_STEP;
+    }
+    controller->last_throughput = throughput;
+
+    double next = (controller->direction > 0) ? controller->current * controller->step : controller->current / controller->step;
+    uint32_t next_items = batch_controller_round(controller, next);
+    if (next_items == controller->current) {
+        //Pinned at a bound - try the other way next time
+        controller->direction = -controller->direction;
+        return;
+    }
+
+    std::cout << "Batch size for " << controller->name << " : " << controller->current << " -> " << next_items
+              << " (" << (uint64_t) throughput << " items/s)" << std::endl;
+    controller->current = next_items;
+}
@@ -0,0 +1,212 @@
+//Checkpoint/resume and sharding of the stimulus file. A checkpoint records how far into the input the run got,
+//how many batches were completed and how much output they produced; it is only written after that output has
+//been flushed, so a resumed run truncates the output to output_offset and re-reads the input from input_offset.
+//A shard is a byte range of the input moved forward to record boundaries - lines, or 4-line records for FASTQ -
+//so shards never share a read.
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+//Move an offset forward to the start of the next record, unless it already is one. A FASTQ record starts with a
+//line beginning with '@' whose third line begins with '+' - a quality line may start with '@', but then the
+//line two below it is a sequence.
+static uint64_t align_to_record(std::ifstream& input, uint64_t offset, uint64_t size, bool fastq) {
+    if ((offset == 0) || (offset >= size)) {
+        return std::min(offset, size);
+    }
+    std::string line, sequence, separator;
+    input.clear();
+    input.seekg(offset - 1);
+    std::getline(input, line);
+    while (fastq && !input.eof()) {
+        uint64_t position = (uint64_t) input.tellg();
+        if (!std::getline(input, line)) break;
+        if ((line[0] == '@') && std::getline(input, sequence) && std::getline(input, separator) && (separator[0] == '+')) {
+            input.clear();
+            input.seekg(position);
+            return position;
+        }
+        input.clear();
+        input.seekg(position);
+        std::getline(input, line);
+    }
+    return input.eof() ? size : (uint64_t) input.tellg();
+}
+
+//A stimulus line is a read, optionally followed by the island's start and end and by the read's quality string
+//(one character per base, as in FASTQ). Qualities shorter than the read are dropped.
+bool parse_stimulus_line(const std::string& line, std::string* read, int32_t* start_position, int32_t* end_position, std::string* quality) {
+    size_t read_end = line.find_first_of(" \t");
+    *read = line.substr(0, read_end);
+    *start_position = 0;
+    *end_position   = 0;
+    quality->clear();
+    if (read_end != std::string::npos) {
+        int32_t consumed = 0;
+        sscanf(line.c_str() + read_end, "%d %d %n", start_position, end_position, &consumed);
+        if (consumed > 0) {
+            size_t quality_start = read_end + consumed;
+            *quality = line.substr(quality_start, line.find_first_of(" \t\r", quality_start) - quality_start);
+        }
+    }
+    if (quality->length() < read->length()) {
+        quality->clear();
+    }
+    return !read->empty();
+}
+
+bool shard_byte_range(const std::string& input_file_name, uint32_t shard_index, uint32_t num_shards, uint64_t* start, uint64_t* end) {
+    std::ifstream input(input_file_name.c_str(), std::ios::binary);
+    if (!input.is_open() || (num_shards == 0) || (shard_index >= num_shards)) {
+        return false;
+    }
+    bool fastq = (input.peek() == '@');
+    input.seekg(0, std::ios::end);
+    uint64_t size = (uint64_t) input.tellg();
+    *start = align_to_record(input, size * shard_index / num_shards, size, fastq);
+    *end   = align_to_record(input, size * (shard_index + 1) / num_shards, size, fastq);
+    return true;
+}
+
+void checkpoint_init(struct run_checkpoint* checkpoint, const std::string& input_file_name, uint32_t shard_index, uint32_t num_shards, uint64_t input_offset, uint64_t input_end) {
+    checkpoint->input_file_name   = input_file_name;
+    checkpoint->shard_index       = shard_index;
+    checkpoint->num_shards        = num_shards;
+    checkpoint->input_offset      = input_offset;
+    checkpoint->input_end         = input_end;
+    checkpoint->batches_completed = 0;
+    checkpoint->reads_processed   = 0;
+    checkpoint->output_offset     = 0;
+    checkpoint->complete          = false;
+}
+
+bool checkpoint_load(const std::string& checkpoint_file_name, struct run_checkpoint* checkpoint) {
+    std::ifstream checkpoint_file(checkpoint_file_name.c_str());
+    std::string line;
+    uint32_t num_fields = 0;
+    if (!checkpoint_file.is_open()) {
+        return false;
+    }
+    checkpoint->complete = false;
+    while (std::getline(checkpoint_file, line)) {
+        std::stringstream fields(line);
+        std::string key;
+        fields >> key;
+        if (key == "input_file")             { fields >> checkpoint->input_file_name; num_fields++; }
+        else if (key == "shard")             { fields >> checkpoint->shard_index >> checkpoint->num_shards; num_fields++; }
+        else if (key == "input_offset")      { fields >> checkpoint->input_offset; num_fields++; }
+        else if (key == "input_end")         { fields >> checkpoint->input_end; num_fields++; }
+        else if (key == "batches_completed") { fields >> checkpoint->batches_completed; num_fields++; }
+        else if (key == "reads_processed")   { fields >> checkpoint->reads_processed; num_fields++; }
+        else if (key == "output_offset")     { fields >> checkpoint->output_offset; num_fields++; }
+        else if (key == "complete")          { fields >> checkpoint->complete; }
+    }
+    if (num_fields != 7) {
+        std::cout << "WARNING! Ignoring incomplete checkpoint " << checkpoint_file_name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//Write to a temporary file, sync it and rename it over the old checkpoint - a crash leaves either the old or the new one
+bool checkpoint_save(const std::string& checkpoint_file_name, const struct run_checkpoint* checkpoint) {
+    std::string temp_file_name = checkpoint_file_name + ".tmp";
+    FILE* checkpoint_file = fopen(temp_file_name.c_str(), "w");
+    if (!checkpoint_file) {
+        std::cout << "WARNING! Cannot write checkpoint " << temp_file_name << std::endl;
+        return false;
+    }
+    fprintf(checkpoint_file, "input_file %s\n", checkpoint->input_file_name.c_str());
+    fprintf(checkpoint_file, "shard %u %u\n", checkpoint->shard_index, checkpoint->num_shards);
+    fprintf(checkpoint_file, "input_offset %lu\n", (uint64_t) checkpoint->input_offset);
+    fprintf(checkpoint_file, "input_end %lu\n", (uint64_t) checkpoint->input_end);
+    fprintf(checkpoint_file, "batches_completed %lu\n", (uint64_t) checkpoint->batches_completed);
+    fprintf(checkpoint_file, "reads_processed %lu\n", (uint64_t) checkpoint->reads_processed);
+    fprintf(checkpoint_file, "output_offset %lu\n", (uint64_t) checkpoint->output_offset);
+    fprintf(checkpoint_file, "complete %d\n", checkpoint->complete ? 1 : 0);
+    fflush(checkpoint_file);
+    fsync(fileno(checkpoint_file));
+    fclose(checkpoint_file);
+    return rename(temp_file_name.c_str(), checkpoint_file_name.c_str()) == 0;
+}
+
+//Flush and sync the output, then record the progress it covers
+bool checkpoint_commit(const std::string& checkpoint_file_name, struct run_checkpoint* checkpoint, FILE* output, uint64_t input_offset) {
+    fflush(output);
+    fsync(fileno(output));
+    checkpoint->input_offset  = input_offset;
+    checkpoint->output_offset = (uint64_t) ftello(output);
+    return checkpoint_save(checkpoint_file_name, checkpoint);
+}
+
+//Open the output of a run - truncated back to the checkpointed position when resuming
+FILE* checkpoint_open_output(const std::string& output_file_name, const struct run_checkpoint* checkpoint, bool resume) {
+    if (!resume) {
+        return fopen(output_file_name.c_str(), "w");
+    }
+    int fd = open(output_file_name.c_str(), O_WRONLY | O_CREAT, 0644);
+    if ((fd < 0) || (ftruncate(fd, checkpoint->output_offset) != 0) || (lseek(fd, 0, SEEK_END) < 0)) {
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    return fdopen(fd, "w");
+}
+
+//Concatenate shard outputs in shard order. Every shard's checkpoint must be complete and all shards of the split present.
+int32_t merge_shard_outputs(const std::string& merged_file_name, char** shard_file_names, int32_t num_files) {
+    std::vector<std::pair<uint32_t, std::string> > shards;
+    uint32_t num_shards = 0;
+    for (int32_t i = 0; i < num_files; i++) {
+        struct run_checkpoint checkpoint;
+        std::string checkpoint_file_name = std::string(shard_file_names[i]) + ".checkpoint";
+        if (!checkpoint_load(checkpoint_file_name, &checkpoint)) {
+            std::cout << "ERROR!!! No checkpoint for shard output " << shard_file_names[i] << std::endl;
+            return -1;
+        }
+        if (!checkpoint.complete) {
+            std::cout << "ERROR!!! Shard " << checkpoint.shard_index << " (" << shard_file_names[i] << ") has not completed" << std::endl;
+            return -1;
+        }
+        if ((num_shards != 0) && (checkpoint.num_shards != num_shards)) {
+            std::cout << "ERROR!!! " << shard_file_names[i] << " belongs to a split into " << checkpoint.num_shards << " shards, not " << num_shards << std::endl;
+            return -1;
+        }
+        num_shards = checkpoint.num_shards;
+        shards.push_back(std::make_pair(checkpoint.shard_index, std::string(shard_file_names[i])));
+    }
+    std::sort(shards.begin(), shards.end());
+    for (uint32_t i = 0; i < shards.size(); i++) {
+        if ((shards.size() != num_shards) || (shards[i].first != i)) {
+            std::cout << "ERROR!!! Shard " << i << " of " << num_shards << " is missing or given twice" << std::endl;
+            return -1;
+        }
+    }
+
+    std::ofstream merged_file(merged_file_name.c_str(), std::ios::binary);
+    if (!merged_file.is_open()) {
+        std::cout << "ERROR!!! Cannot open " << merged_file_name << std::endl;
+        return -1;
+    }
+    for (uint32_t i = 0; i < shards.size(); i++) {
+        struct run_checkpoint checkpoint;
+        checkpoint_load(shards[i].second + ".checkpoint", &checkpoint);
+        std::ifstream shard_file(shards[i].second.c_str(), std::ios::binary);
+        std::vector<char> buffer(1 << 20);
+        uint64_t remaining = checkpoint.output_offset;      //Anything past the last checkpoint was never committed
+        while (remaining > 0) {
+            shard_file.read(&buffer[0], std::min((uint64_t) buffer.size(), remaining));
+            if (shard_file.gcount() <= 0) break;
+            merged_file.write(&buffer[0], shard_file.gcount());
+            remaining -= shard_file.gcount();
+        }
+        if (remaining != 0) {
+            std::cout << "ERROR!!! " << shards[i].second << " is shorter than its checkpoint" << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "Merged " << shards.size() << " shards into " << merged_file_name << std::endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+//Multi-round correction. After a CORRECTION pass the best candidate of every read is applied in place, the reads
+//are profiled again, and only those that still have a non-solid island and were changed by the last round are
+//compacted into the next CORRECTION batch. Each round is therefore a fraction of the size of the previous one.
+//The re-profiles are Bloom filter queries like any other, so they go into the correction report's counts.
+
+bool correction_workspace_init(struct correction_workspace* workspace, fenome::accelerator* accelerator, uint32_t capacity) {
+    workspace->capacity         = capacity + (capacity % 2);
+    workspace->profile_space    = (char*) accelerator->allocate_buffer((uint64_t) workspace->capacity * 256);
+    workspace->index_space      = (int32_t*) accelerator->allocate_buffer((uint64_t) workspace->capacity * 256);
+    workspace->compact_space    = (char*) accelerator->allocate_buffer((uint64_t) workspace->capacity * 512);
+    workspace->candidate_space  = (char*) accelerator->allocate_buffer((uint64_t) workspace->capacity * 256 * 32);
+    workspace->pending          = new uint32_t[workspace->capacity];
+    workspace->changed          = new bool[workspace->capacity];
+    return workspace->profile_space && workspace->index_space && workspace->compact_space && workspace->candidate_space;
+}
+
+void correction_workspace_free(struct correction_workspace* workspace) {
+    fenome::accelerator::release_buffer(workspace->profile_space);
+    fenome::accelerator::release_buffer(workspace->index_space);
+    fenome::accelerator::release_buffer(workspace->compact_space);
+    fenome::accelerator::release_buffer(workspace->candidate_space);
+    delete[] workspace->pending;
+    delete[] workspace->changed;
+}
+
+//Apply the chosen candidate of every item to the read. Returns the number of reads that changed.
+static uint32_t apply_candidates(char* read_space, const uint32_t* items, uint32_t num_items, char* candidate_space, const struct host_kernels* kernels, bool* changed, uint32_t* num_with_candidates) {
+    uint32_t num_changed = 0;
+    *num_with_candidates = 0;
+    for (uint32_t m = 0; m < num_items; m++) {
+        char* read_item = read_space + (uint64_t) items[m] * 512;
+        char* candidate_local_space = candidate_space + (uint64_t) m * 256 * 32;
+        int32_t read_length = (uint8_t) read_item[255];
+        int32_t best_candidate = choose_candidate(candidate_local_space, read_item, read_length, kernels);
+        changed[m] = false;
+        if (best_candidate < 0) continue;
+        (*num_with_candidates)++;
+        const char* candidate = candidate_local_space + best_candidate * 256;
+        if (kernels->count_differences(candidate, read_item, read_length) > 0) {
+            memcpy(read_item, candidate, read_length);
+            changed[m] = true;
+            num_changed++;
+        }
+    }
+    return num_changed;
+}
+
+int32_t run_correction_rounds(fenome::accelerator* accelerator, struct correction_workspace* workspace, const struct host_kernels* kernels, const fenome::batch* correction_batch, uint32_t num_reads, uint32_t max_rounds, struct correction_round_statistics* statistics, struct correction_counters* counters) {
+    char* read_space = correction_batch->read_space;
+    uint32_t num_pending = num_reads;
+    uint32_t round = 0;
+
+    for (uint32_t m = 0; m < num_reads; m++) {
+        workspace->pending[m] = m;
+    }
+
+    //Round 0 was run by the caller on read_space itself, with its results in correction_batch->write_space
+    char* candidate_space = correction_batch->write_space;
+
+    while (true) {
+        struct correction_round_statistics* round_statistics = &statistics[round];
+        uint32_t num_with_candidates;
+        round_statistics->reads_submitted += num_pending;
+
+        uint32_t num_changed = apply_candidates(read_space, workspace->pending, num_pending, candidate_space, kernels, workspace->changed, &num_with_candidates);
+        round_statistics->reads_with_candidates += num_with_candidates;
+        round_statistics->reads_changed         += num_changed;
+        if ((num_changed == 0) || (round + 1 >= max_rounds)) {
+            break;
+        }
+
+        //Re-profile the reads that changed
+        uint32_t num_profiled = 0;
+        for (uint32_t m = 0; m < num_pending; m++) {
+            if (!workspace->changed[m]) continue;
+            char* read_item    = read_space + (uint64_t) workspace->pending[m] * 512;
+            char* profile_item = workspace->profile_space + (uint64_t) num_profiled * 256;
+            memcpy(profile_item, read_item, 256);
+            workspace->pending[num_profiled++] = workspace->pending[m];
+        }
+
+        fenome::batch profile_batch;
+        profile_batch.mode        = fenome::afu_mode::solid_islands;
+        profile_batch.num_items   = num_profiled;
+        profile_batch.read_space  = workspace->profile_space;
+        profile_batch.write_space = (char*) workspace->index_space;
+        fenome::batch_result result = accelerator->submit(profile_batch).get();
+        if (!result.success) return -1;
+        round_statistics->device_ns += result.device_ns;
+
+        //Compact the reads that still have a non-solid island into the next correction batch
+        num_pending = 0;
+        for (uint32_t m = 0; m < num_profiled; m++) {
+            char* read_item = read_space + (uint64_t) workspace->pending[m] * 512;
+            int32_t start_position, end_position;
+            correction_report_add_profile(counters, workspace->index_space + 64 * m, (uint8_t) read_item[255], kernels->kmer_length);
+            int32_t island_type = classify_read_islands(workspace->index_space + 64 * m, (uint8_t) read_item[255], kernels->kmer_length, &start_position, &end_position);
+            if (island_type == SOLID_READ) {
+                round_statistics->reads_solid++;
+                continue;
+            }
+            read_item[254] = start_position;
+            read_item[253] = end_position;
+            memcpy(workspace->compact_space + (uint64_t) num_pending * 512, read_item, 512);
+            workspace->pending[num_pending++] = workspace->pending[m];
+        }
+        if (num_pending == 0) {
+            break;
+        }
+
+        round++;
+        fenome::batch next_batch = *correction_batch;
+        next_batch.num_items   = num_pending;
+        next_batch.read_space  = workspace->compact_space;
+        next_batch.write_space = workspace->candidate_space;
+        result = accelerator->submit(next_batch).get();
+        if (!result.success) return -1;
+        statistics[round].device_ns += result.device_ns;
+        candidate_space = workspace->candidate_space;
+    }
+    return round + 1;
+}
+
+void print_correction_round_statistics(const struct correction_round_statistics* statistics, uint32_t max_rounds) {
+    for (uint32_t round = 0; round < max_rounds; round++) {
+        const struct correction_round_statistics* round_statistics = &statistics[round];
+        if (round_statistics->reads_submitted == 0) break;
+        std::cout << "Round " << round + 1 << " : " << round_statistics->reads_submitted << " reads, "
+                  << round_statistics->reads_with_candidates << " with candidates, "
+                  << round_statistics->reads_changed << " changed, "
+                  << round_statistics->reads_solid << " solid after re-profiling, "
+                  << round_statistics->device_ns / 1e6 << " ms device time" << std::endl;
+    }
+}
@@ -0,0 +1,111 @@
+//What a run did to its reads - outcome counts, candidates per read, where and at which quality the accepted
+//substitutions fall, island types and how many queried k-mers the Bloom filter reported solid.
+//Every thread gets its own cache-line aligned block of plain counters; blocks are only summed once the
+//threads are done, so the hot path is a handful of increments into memory no other thread touches.
+
+struct correction_counters* correction_report_register_thread(struct correction_report* report) {
+    int32_t index = report->num_threads.fetch_add(1);
+    if (index >= TELEMETRY_MAX_THREADS) {
+        return NULL;
+    }
+    memset(&report->threads[index], 0, sizeof(struct correction_counters));
+    return &report->threads[index];
+}
+
+void correction_report_add_read(struct correction_counters* counters, const char* read_item, const char* candidate_local_space, const struct host_kernels* kernels, const uint8_t* levels) {
+    if (!counters) return;
+    int32_t read_length    = (uint8_t) read_item[255];
+    int32_t num_candidates = std::min((int32_t) (uint8_t) candidate_local_space[255], 32);
+    const uint8_t* quality = (const uint8_t*) read_item + 256;
+
+    counters->reads++;
+    counters->candidates_per_read[num_candidates]++;
+    counters->island_types[island_type_from_coordinates((uint8_t) read_item[254], (uint8_t) read_item[253], read_length)]++;
+
+    int32_t best_candidate = choose_candidate(candidate_local_space, read_item, read_length, kernels);
+    if (best_candidate < 0) {
+        counters->reads_uncorrectable++;
+        return;
+    }
+    const char* candidate = candidate_local_space + best_candidate * 256;
+    if (kernels->count_differences(candidate, read_item, read_length) == 0) {
+        counters->reads_untouched++;
+        return;
+    }
+    counters->reads_corrected++;
+    for (int32_t i = 0; i < read_length; i++) {
+        uint32_t level = compress_quality(quality[i], levels);
+        counters->bases_by_quality[level]++;
+        if (candidate[i] != read_item[i]) {
+            counters->substitutions_by_position[i]++;
+            counters->substitutions_by_quality[level]++;
+        }
+    }
+}
+
+void correction_report_add_profile(struct correction_counters* counters, const int32_t* index_base, int32_t read_length, int32_t kmer_length) {
+    if (!counters) return;
+    counters->kmers_queried += read_length - kmer_length + 1;
+    for (int32_t n = 0; (n < 32) && (index_base[2 * n] != -1); n++) {
+        counters->kmers_solid += index_base[2 * n + 1];
+    }
+}
+
+static void write_json_array(FILE* report_file, const char* name, const uint64_t* values, int32_t num_values, bool last) {
+    fprintf(report_file, "  \"%s\": [", name);
+    for (int32_t i = 0; i < num_values; i++) {
+        fprintf(report_file, "%s%lu", i ? ", " : "", (unsigned long) values[i]);
+    }
+    fprintf(report_file, "]%s\n", last ? "" : ",");
+}
+
+//Merge the per-thread blocks and write the JSON report - call after every registered thread is done
+bool correction_report_write(struct correction_report* report, const std::string& report_file_name) {
+    struct correction_counters total;
+    memset(&total, 0, sizeof(total));
+    int32_t num_threads = std::min((int32_t) report->num_threads.load(), TELEMETRY_MAX_THREADS);
+    for (int32_t t = 0; t < num_threads; t++) {
+        const struct correction_counters* counters = &report->threads[t];
+        total.reads               += counters->reads;
+        total.reads_corrected     += counters->reads_corrected;
+        total.reads_uncorrectable += counters->reads_uncorrectable;
+        total.reads_untouched     += counters->reads_untouched;
+        total.kmers_queried       += counters->kmers_queried;
+        total.kmers_solid         += counters->kmers_solid;
+        for (int32_t i = 0; i < 33; i++) total.candidates_per_read[i] += counters->candidates_per_read[i];
+        for (int32_t i = 0; i < NUM_ISLAND_TYPES; i++) total.island_types[i] += counters->island_types[i];
+        for (int32_t i = 0; i < 4; i++) {
+            total.substitutions_by_quality[i] += counters->substitutions_by_quality[i];
+            total.bases_by_quality[i]         += counters->bases_by_quality[i];
+        }
+        for (int32_t i = 0; i < MAX_READ_LENGTH; i++) total.substitutions_by_position[i] += counters->substitutions_by_position[i];
+    }
+
+    FILE* report_file = fopen(report_file_name.c_str(), "w");
+    if (!report_file) {
+        std::cout << "WARNING! Cannot write correction report " << report_file_name << std::endl;
+        return false;
+    }
+    int32_t num_positions = MAX_READ_LENGTH;
+    while ((num_positions > 0) && (total.substitutions_by_position[num_positions - 1] == 0)) num_positions--;
+
+    fprintf(report_file, "{\n");
+    fprintf(report_file, "  \"reads\": {\"total\": %lu, \"corrected\": %lu, \"uncorrectable\": %lu, \"untouched\": %lu},\n",
+            (unsigned long) total.reads, (unsigned long) total.reads_corrected, (unsigned long) total.reads_uncorrectable, (unsigned long) total.reads_untouched);
+    fprintf(report_file, "  \"island_types\": {\"five_prime\": %lu, \"between\": %lu, \"three_prime\": %lu, \"no_solid\": %lu},\n",
+            (unsigned long) total.island_types[FIVE_PRIME], (unsigned long) total.island_types[BETWEEN], (unsigned long) total.island_types[THREE_PRIME], (unsigned long) total.island_types[NO_SOLID]);
+    //Only profiles query the filter - a single-round correction run has nothing to report here
+    if (total.kmers_queried == 0) {
+        fprintf(report_file, "  \"bloom\": null,\n");
+    } else {
+        fprintf(report_file, "  \"bloom\": {\"kmers_queried\": %lu, \"kmers_solid\": %lu, \"positive_rate\": %.6f},\n",
+                (unsigned long) total.kmers_queried, (unsigned long) total.kmers_solid, (double) total.kmers_solid / total.kmers_queried);
+    }
+    write_json_array(report_file, "candidates_per_read", total.candidates_per_read, 33, false);
+    write_json_array(report_file, "substitutions_by_position", total.substitutions_by_position, num_positions, false);
+    write_json_array(report_file, "substitutions_by_quality_level", total.substitutions_by_quality, 4, false);
+    write_json_array(report_file, "bases_by_quality_level", total.bases_by_quality, 4, true);
+    fprintf(report_file, "}\n");
+    fclose(report_file);
+    return true;
+}
@@ -3,9 +3,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fstream>
+#include <memory>
 #include "fenome.hpp"
 #include "error_correction.cpp"
-#include "register_operations.cpp"
 
 int main(int argc, char** argv) {
 
@@ -52,20 +52,26 @@ int main(int argc, char** argv) {
 
     std::cout << "Assigned space for ddr space";
  
-    open_device((uint64_t) 0)
-    wait_for_idle(afu_h);
-    clear_status(afu_h);
+    std::unique_ptr<fenome::device> afu;
+    try {
+        afu.reset(new fenome::device((uint64_t) 0));
+    } catch (const fenome::device_error& error) {
+        std::cout << error.what() << std::endl;
+        return -1;
+    }
+    afu->wait_for_idle();
+    afu->clear_status();
 
     std::cout << "Device has woken up" << std::endl;
 
-    cxl_mmio_write64(afu_h,WRITE_BASE,(uint64_t)ddr_space);
-    cxl_mmio_write32(afu_h,DDR3_BASE,0);
-    cxl_mmio_write32(afu_h,CONTROL,SetControlRegister(DDR3_READ,0,0));
-    cxl_mmio_write32(afu_h,START,0xdead);
+    afu->write64(fenome::afu_register::write_base,(uint64_t)ddr_space);
+    afu->write32(fenome::afu_register::ddr3_base,0);
+    afu->write32(fenome::afu_register::control,SetControlRegister(DDR3_READ,0,0));
+    afu->start();
 
     std::cout << "Completed initialization and triggered DDR reads ... Waiting ... " << std::endl;
    
-    wait_for_idle(afu_h);
+    afu->wait_for_idle();
     
     //1. 
 
@@ -353,7 +359,7 @@ int main(int argc, char** argv) {
 //        }
 //    }
 //
-    close_device
+    afu.reset();
 
     std::cout << "Closing program ... " << std::endl;
     return 0;
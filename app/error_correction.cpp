@@ -1,6 +1,59 @@
 void adjust_solid_islands(int32_t** index_space, uint32_t num_items);
                                                                           //TBD: Adapt from GENE code
 
+//Locate the first non-solid region of a profiled read, in k-mer positions, using the same conventions as set_correction_types below.
+//Returns SOLID_READ if one island covers every k-mer of the read.
+int32_t classify_read_islands(const int32_t* index_base, int32_t read_length, int32_t kmer_length, int32_t* start_position, int32_t* end_position) {
+    int32_t num_kmers = read_length - kmer_length + 1;
+    int32_t first_start  = index_base[0];
+    int32_t first_length = index_base[1];
+
+    if (first_start == -1) {
+        *start_position = 0;
+        *end_position   = read_length - 1;
+        return NO_SOLID;
+    }
+    if ((first_start == 0) && (first_length >= num_kmers)) {
+        return SOLID_READ;
+    }
+    if (first_start > 0) {
+        *start_position = first_start - 1;
+        *end_position   = 0;
+        return FIVE_PRIME;
+    }
+    if (index_base[2] != -1) {
+        *start_position = first_start + first_length;
+        *end_position   = index_base[2] - 1;
+        return BETWEEN;
+    }
+    *start_position = first_start + first_length;
+    *end_position   = read_length - 1;
+    return THREE_PRIME;
+}
+
+//Island type from the coordinates classify_read_islands produced, as a read item carries them
+int32_t island_type_from_coordinates(int32_t start_position, int32_t end_position, int32_t read_length) {
+    if (end_position == 0) return FIVE_PRIME;
+    if (end_position < read_length - 1) return BETWEEN;
+    return (start_position == 0) ? NO_SOLID : THREE_PRIME;
+}
+
+//Pick the candidate with the fewest substitutions; ties go to the one the AFU reported first. -1 if there are none.
+int32_t choose_candidate(const char* candidate_local_space, const char* read, int32_t read_length, const struct host_kernels* kernels) {
+    int32_t num_candidates = (uint8_t) candidate_local_space[255];
+    int32_t best_candidate = -1;
+    int32_t best_differences = read_length + 1;
+    if (num_candidates > 32) num_candidates = 32;
+    for (int n = 0; n < num_candidates; n++) {
+        int32_t num_differences = kernels->count_differences(candidate_local_space + n * 256, read, read_length);
+        if (num_differences < best_differences) {
+            best_differences = num_differences;
+            best_candidate   = n;
+        }
+    }
+    return best_candidate;
+}
+
 ///Each read is primed for correction
 //int set_correction_types(struct correction_item* correction_array, uint32_t num_items, uint32_t** candidate_space, uint32_t** correction_space) {
 
@@ -3,9 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fstream>
+#include <unistd.h>
 #include "fenome.hpp"
 #include "error_correction.cpp"
-#include "register_operations.cpp"
+#include "correction_rounds.cpp"
+#include "batch_controller.cpp"
+#include "checkpoint.cpp"
+#include "workload.cpp"
+#include "correction_statistics.cpp"
+#include "profiling.cpp"
+#include "autotune.cpp"
+#include "long_reads.cpp"
 
 int main(int argc, char** argv) {
 
@@ -13,14 +21,30 @@ int main(int argc, char** argv) {
     //std::string kmer_file_name = "./test_kmers.txt";
     std::string kmer_file_name = "./solid_kmers.txt";
     std::ifstream input_file(read_file.c_str());
-    std::ifstream kmer_file(kmer_file_name.c_str());
+    std::string stimulus_file_name = "./stimulus.txt";
+    std::ifstream kmer_file;
     std::string read_string;
     std::string line_id;
     std::string line_misc;
     std::string quality_string("IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII00000000000000000000000000000000IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII");
     std::string kmer_string;
+    std::string metrics_file_name = "./fenome.prom";
+    std::string summary_file_name = "./fenome_summary.json";
+    std::string report_file_name = "./fenome_report.json";
+    std::string qc_file_name = "./fenome_qc.json";
+    bool profile_only = false;
+    bool autotune = false;
+    double autotune_target = 0;
+    std::string add_kmer_file_name;
+    std::string remove_kmer_file_name;
+    static struct resident_kmers resident;
+    struct kmer_delta_statistics delta_statistics;
     int32_t read_length=112;
     int32_t kmer_length=30;
+    struct host_kernels kernels;
+    uint32_t max_rounds = 1;
+    struct correction_workspace workspace = {};
+    struct correction_round_statistics round_statistics[MAX_CORRECTION_ROUNDS] = {};
     int32_t threshold;
     uint8_t level0;
     uint8_t level1;
@@ -29,58 +53,184 @@ int main(int argc, char** argv) {
     int num_reads_processed = 0;
     int num_reads_per_iteration = 512;
     int num_kmers_per_iteration = 512 * 4;
+    struct batch_controller read_controller;
+    struct batch_controller kmer_controller;
 
-    char* kmer_space;
+    char* kmer_space = NULL;
     uint32_t** correction_space;
-    char* candidate_space;
-    char* read_space;
+    char* candidate_space = NULL;
+    char* read_space = NULL;
+    char* composed_space = NULL;
+    uint32_t kmer_space_items = 0, candidate_space_items = 0, read_space_items = 0, composed_space_items = 0;
+    struct batch_composition composition;
+    struct long_reads long_reads;
     int32_t* index_space;
     struct correction_item* correction_array;
+    static struct telemetry_state telemetry;
+    std::unique_ptr<fenome::accelerator> accelerator;
+    fenome::batch batch;
+    struct telemetry_counters* counters;
+    static struct correction_report report;
+    struct correction_counters* correction_counters = correction_report_register_thread(&report);
+    uint64_t stage_time;
+    std::string output_file_name;
+    std::string checkpoint_file_name;
+    std::string merged_file_name;
+    std::string device_path;
+    uint32_t shard_index = 0;
+    uint32_t num_shards = 1;
+    struct run_checkpoint checkpoint;
+    bool resume = false;
+    FILE* output = stdout;
 
 
+    int option;
+    while ((option = getopt(argc, argv, "k:r:s:i:n:o:c:S:m:d:pa:x:At:")) != -1) {
+        switch (option) {
+            case 'k' : kmer_length = atoi(optarg); break;
+            case 'r' : read_length = atoi(optarg); break;
+            case 's' : kmer_file_name = optarg; break;
+            case 'i' : stimulus_file_name = optarg; break;
+            case 'n' : max_rounds = std::max(1, std::min(atoi(optarg), MAX_CORRECTION_ROUNDS)); break;
+            case 'o' : output_file_name = optarg; break;
+            case 'c' : checkpoint_file_name = optarg; break;
+            case 'S' : 
+                if ((sscanf(optarg, "%u/%u", &shard_index, &num_shards) != 2) || (shard_index >= num_shards)) {
+                    std::cout << "Shards are given as index/count, e.g. -S 0/8" << std::endl;
+                    return -1;
+                }
+                break;
+            case 'm' : merged_file_name = optarg; break;
+            case 'd' : device_path = optarg; break;
+            case 'p' : profile_only = true; break;
+            case 'a' : add_kmer_file_name = optarg; break;
+            case 'x' : remove_kmer_file_name = optarg; break;
+            case 'A' : autotune = true; break;
+            case 't' : autotune = true; autotune_target = atof(optarg); break;
+            default :
+                std::cout << "Usage: " << argv[0] << " [-k kmer_length] [-r max_read_length] [-s solid_kmer_file] [-i stimulus_file] [-n correction_rounds] [-o output_file] [-c checkpoint_file] [-S shard/num_shards] [-d afu_device] [-p] [-a added_kmer_file] [-x removed_kmer_file] [-A] [-t target_correction_rate]" << std::endl;
+                std::cout << "       " << argv[0] << " -m merged_output shard_output ..." << std::endl;
+                std::cout << "Stimulus lines are 'read [start end [quality]]' - reads without a quality string get a fixed one." << std::endl;
+                std::cout << "-A and -t tune the CORRECTION quality levels and 2-bit quality threshold on the reads that carry a quality" << std::endl;
+                std::cout << "string. The Bloom filter (CBF) threshold is fixed at 0 in the bitstream and is not tuned." << std::endl;
+                return -1;
+        }
+    }
+    if (!merged_file_name.empty()) {
+        return merge_shard_outputs(merged_file_name, argv + optind, argc - optind);
+    }
+
+    //Decide where to start before touching the card - a completed run has nothing left to do
+    uint64_t input_start, input_end;
+    if (!shard_byte_range(stimulus_file_name, shard_index, num_shards, &input_start, &input_end)) {
+        std::cout << "ERROR!! Cannot open stimulus file" << std::endl;
+        return -1;
+    }
+    if (checkpoint_file_name.empty() && !output_file_name.empty()) {
+        checkpoint_file_name = output_file_name + ".checkpoint";
+    }
+    if (!output_file_name.empty()) {                 //Keep the side files of separate runs (e.g. shards) apart
+        metrics_file_name = output_file_name + ".prom";
+        summary_file_name = output_file_name + "_summary.json";
+        report_file_name  = output_file_name + "_report.json";
+        qc_file_name      = output_file_name + "_qc.json";
+    }
+    if (!checkpoint_file_name.empty() && output_file_name.empty()) {
+        std::cout << "Checkpoints need an output file (-o)" << std::endl;
+        return -1;
+    }
+    if (profile_only && output_file_name.empty()) {
+        std::cout << "Island records are binary - profiling needs an output file (-o)" << std::endl;
+        return -1;
+    }
+    checkpoint_init(&checkpoint, stimulus_file_name, shard_index, num_shards, input_start, input_end);
+    if (!checkpoint_file_name.empty() && checkpoint_load(checkpoint_file_name, &checkpoint)) {
+        if ((checkpoint.input_file_name != stimulus_file_name) || (checkpoint.shard_index != shard_index) || (checkpoint.num_shards != num_shards) || (checkpoint.input_end != input_end)) {
+            std::cout << "ERROR!!! " << checkpoint_file_name << " belongs to a different input or shard" << std::endl;
+            return -1;
+        }
+        if (checkpoint.complete) {
+            std::cout << "Checkpoint " << checkpoint_file_name << " says this run is complete" << std::endl;
+            return 0;
+        }
+        resume = true;
+        std::cout << "Resuming after " << checkpoint.batches_completed << " batches (" << checkpoint.reads_processed << " reads) at input offset " << checkpoint.input_offset << std::endl;
+    }
+    if (!output_file_name.empty() && !(output = checkpoint_open_output(output_file_name, &checkpoint, resume))) {
+        std::cout << "ERROR!!! Cannot open output file " << output_file_name << std::endl;
+        return -1;
+    }
+    if (!fenome::select_host_kernels(&kernels, kmer_length, read_length)) {
+        return -1;
+    }
+    kmer_file.open(kmer_file_name.c_str());
+
+    batch_controller_init(&kmer_controller, "k-mers", num_kmers_per_iteration, MIN_KMERS_PER_ITERATION, KMER_ITEM_GRANULARITY, KMER_ITEM_BYTES, BATCH_MEMORY_BUDGET);
+    batch_controller_init(&read_controller, "reads", num_reads_per_iteration, MIN_READS_PER_ITERATION, READ_ITEM_GRANULARITY,
+                          READ_ITEM_BYTES + ((max_rounds > 1) ? READ_ROUND_ITEM_BYTES : 0), BATCH_MEMORY_BUDGET);
+
+    try {
+        accelerator.reset(new fenome::accelerator(kmer_length, kmer_file_name, 0, device_path));
+    } catch (const fenome::device_error& error) {
+        std::cout << error.what() << std::endl;
+        return -1;
+    }
+
+    //This thread packs every buffer the AFU touches - keep it and the buffers on the card's socket
+    accelerator->pin_to_card();
+
 //First program solid k-mers into the bloom-filter
-    if (posix_memalign((void**)&kmer_space, 128, num_kmers_per_iteration * 64) != 0) {
-        std::cout << "ERROR!!!" << std::endl;
+    fenome::device& afu = accelerator->afu();
+    const fenome::afu_register registers[] = {
+        fenome::afu_register::control, fenome::afu_register::threshold, fenome::afu_register::read_base, fenome::afu_register::write_base,
+        fenome::afu_register::reads_received, fenome::afu_register::reads_written, fenome::afu_register::num_items, fenome::afu_register::start,
+        fenome::afu_register::reset, fenome::afu_register::status, fenome::afu_register::ddr3_base
+    };
+    for (const fenome::afu_register reg : registers) {
+        std::cout << afu.read32(reg) << std::endl;
     }
+    afu.wait_for_idle();
+    afu.clear_status();
+
+    fenome::telemetry_start(&telemetry, &afu, metrics_file_name, summary_file_name, TELEMETRY_INTERVAL_MS);
+    counters = fenome::telemetry_register_thread(&telemetry, "main");
+    accelerator->attach_telemetry(&telemetry);
 
-    open_device((uint64_t) 0)
-    uint32_t val;
-    cxl_mmio_read32(afu_h,CONTROL,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,THRESHOLD,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,READ_BASE,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,WRITE_BASE,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,READS_RECEIVED,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,READS_WRITTEN,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,NUM_ITEMS,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,START,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,RESET,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,STATUS,&val);
-    std::cout << val << std::endl;
-    cxl_mmio_read32(afu_h,DDR3_BASE,&val);
-    std::cout << val << std::endl;
-    wait_for_idle(afu_h);
-    clear_status(afu_h);
     if (!kmer_file.is_open()) {
         std::cout << "Cannot open k-mer file!!!" << std::endl;
+        fenome::telemetry_stop(&telemetry);
         return -1;
     }
     int32_t num_kmers = 0;
+    int32_t num_invalid_kmers = 0;
+    int32_t num_kmers_in_batch = 0;
+    std::string first_kmer_in_batch;
+    std::vector<std::pair<std::string, uint32_t>> padded_kmer_batches;  //Batches set_kmer_program_mode padded with copies of their first k-mer
+    num_kmers_per_iteration = batch_controller_size(&kmer_controller);
+    if ((kmer_space = batch_buffer_reserve(accelerator.get(), kmer_space, &kmer_space_items, num_kmers_per_iteration, KMER_ITEM_BYTES)) == NULL) {
+        std::cout << "ERROR!!! Cannot allocate space for k-mers" << std::endl;
+        fenome::telemetry_stop(&telemetry);
+        return -1;
+    }
+    stage_time = fenome::telemetry_now_ns();
     while (std::getline(kmer_file, kmer_string)) {
-        memcpy(kmer_space + (num_kmers % num_kmers_per_iteration) * 64, kmer_string.c_str(), kmer_length);
+        if (((int32_t) kmer_string.length() < kmer_length) || !kernels.pack_kmer(kmer_space + num_kmers_in_batch * 64, kmer_string.c_str(), kmer_length)) {
+            num_invalid_kmers++;
+            continue;
+        }
+        if (num_kmers_in_batch == 0) {
+            first_kmer_in_batch = kmer_string;
+        }
         num_kmers++;
-        if (num_kmers % num_kmers_per_iteration == 0) {
+        num_kmers_in_batch++;
+        if (num_kmers_in_batch == num_kmers_per_iteration) {
             std::cout << "Completed collecting k-mers" << std::endl;
-            set_kmer_program_mode(afu_h, num_kmers_per_iteration, kmer_length, kmer_space);
-            Start;
+            uint64_t device_time = fenome::telemetry_now_ns();
+            fenome::telemetry_add_stage(counters, STAGE_PARSE, device_time - stage_time);
+            batch.mode        = fenome::afu_mode::program;
+            batch.num_items   = num_kmers_per_iteration;
+            batch.read_space  = kmer_space;
+            batch.write_space = NULL;
 #ifdef DEBUG
             FILE* debug = fopen("./debug", "w");
             for (int x = 0; x < num_kmers_per_iteration; x++) {
@@ -91,28 +241,47 @@ int main(int argc, char** argv) {
                 fprintf(debug, "\n");
             }
 #endif
-            //Wait for IDLE
-            bool success = wait_for_idle(afu_h);
-            if (!success) {
+            //Run and wait for IDLE
+            if (!accelerator->submit(batch).get().success) {
                 std::cout << "Cannot complete AFU transactions. Exiting!!!" << std::endl;
+                fenome::telemetry_stop(&telemetry);
+                return -1;
+            }
+            uint64_t parse_time = stage_time;
+            stage_time = fenome::telemetry_now_ns();
+            if (num_kmers_per_iteration % 8 != 0) {
+                padded_kmer_batches.push_back(std::make_pair(first_kmer_in_batch, (uint32_t) num_kmers_per_iteration));
+            }
+            batch_controller_update(&kmer_controller, num_kmers_in_batch, device_time - parse_time, stage_time - device_time);
+            num_kmers_per_iteration = batch_controller_size(&kmer_controller);
+            num_kmers_in_batch = 0;
+            if ((kmer_space = batch_buffer_reserve(accelerator.get(), kmer_space, &kmer_space_items, num_kmers_per_iteration, KMER_ITEM_BYTES)) == NULL) {
+                std::cout << "ERROR!!! Cannot allocate space for k-mers" << std::endl;
+                fenome::telemetry_stop(&telemetry);
                 return -1;
             }
-            clear_status(afu_h);
             std::cout << "Completed iteration" << std::endl;
         }
     }
 
-    if (num_kmers % num_kmers_per_iteration != 0) {
+    if (num_kmers_in_batch != 0) {
         std::cout << "The last set of k-mers going to be tested ... " << std::endl;
-        int32_t num_remaining = num_kmers % num_kmers_per_iteration;
-        set_kmer_program_mode(afu_h, num_remaining, kmer_length, kmer_space);
-        Start;
-        bool success = wait_for_idle(afu_h);
-        if (!success) {
+        int32_t num_remaining = num_kmers_in_batch;
+        uint64_t device_time = fenome::telemetry_now_ns();
+        fenome::telemetry_add_stage(counters, STAGE_PARSE, device_time - stage_time);
+        batch.mode        = fenome::afu_mode::program;
+        batch.num_items   = num_remaining;
+        batch.read_space  = kmer_space;
+        batch.write_space = NULL;
+        if (!accelerator->submit(batch).get().success) {
             std::cout << "Cannot complete AFU transactions. Exiting!!!" << std::endl;
+            fenome::telemetry_stop(&telemetry);
             return -1;
         }
-        clear_status(afu_h);
+        stage_time = fenome::telemetry_now_ns();
+        if (num_remaining % 8 != 0) {
+            padded_kmer_batches.push_back(std::make_pair(first_kmer_in_batch, (uint32_t) num_remaining));
+        }
         std::cout << "Completed last iteration" << std::endl;
     }
 
@@ -252,100 +421,290 @@ int main(int argc, char** argv) {
 //    open_device((uint64_t) 0)
 //    clear_status(afu_h);
  
-    std::ifstream test_file("./stimulus.txt");
-    if (!test_file.is_open()) {
-        std::cout << "ERROR!! Cannot open stimulus file" << std::endl;
+    if (num_invalid_kmers > 0) {
+        std::cout << "WARNING! Skipped " << num_invalid_kmers << " k-mers that are too short or not ACGT" << std::endl;
+    }
+
+    //k-mer deltas on top of the solid k-mer file
+    if (!add_kmer_file_name.empty() || !remove_kmer_file_name.empty()) {
+        fenome::resident_kmers_init(&resident, kmer_length);
+        fenome::resident_kmers_load(&resident, kmer_file_name);
+        for (uint32_t b = 0; b < padded_kmer_batches.size(); b++) {
+            fenome::resident_kmers_add_padding(&resident, padded_kmer_batches[b].first, padded_kmer_batches[b].second);
+        }
+        accelerator->track_kmers(&resident);
+        stage_time = fenome::telemetry_now_ns();
+        if (fenome::apply_kmer_delta(accelerator.get(), &resident, &kernels, add_kmer_file_name, remove_kmer_file_name, &delta_statistics) < 0) {
+            std::cout << "Cannot apply the k-mer delta. Exiting!!!" << std::endl;
+            fenome::telemetry_stop(&telemetry);
+            return -1;
+        }
+        std::cout << "Applied the k-mer delta in " << (fenome::telemetry_now_ns() - stage_time) / 1e9 << " s" << std::endl;
+        fenome::print_kmer_delta_statistics(&resident, &delta_statistics);
     }
 
-    if (posix_memalign((void**)&read_space, 128, num_reads_per_iteration * 256 *2) != 0) {
-        std::cout << "ERROR!!!" << std::endl;
+    //Profiling only - island records instead of corrections
+    if (profile_only) {
+        static struct profile_qc qc;
+        std::ifstream profile_file(stimulus_file_name.c_str(), std::ios::binary);
+        profile_file.seekg(checkpoint.input_offset);
+        if (run_profiling(accelerator.get(), &kernels, profile_file, &checkpoint, checkpoint_file_name, output, &qc, correction_counters, counters) < 0) {
+            std::cout << "ERROR! Read profile doesn't complete!!!" << std::endl;
+            fenome::telemetry_stop(&telemetry);
+            return -1;
+        }
+        profile_qc_write(&qc, qc_file_name);
+        correction_report_write(&report, report_file_name);
+        if (!checkpoint_file_name.empty()) {
+            checkpoint.complete = true;
+            checkpoint_commit(checkpoint_file_name, &checkpoint, output, checkpoint.input_end);
+        }
+        fclose(output);
+        fenome::telemetry_stop(&telemetry);
+        accelerator.reset();
+        std::cout << "Closing program ... " << std::endl;
+        return 0;
     }
 
-    if (posix_memalign((void**)&candidate_space, 128, num_reads_per_iteration * 256 * 32) != 0) {
-        std::cout << "ERROR!!!" << std::endl;
+    std::ifstream test_file(stimulus_file_name.c_str(), std::ios::binary);
+    if (!test_file.is_open()) {
+        std::cout << "ERROR!! Cannot open stimulus file" << std::endl;
     }
+    test_file.seekg(checkpoint.input_offset);
 
     num_reads_processed = 0;
-    char quality_string_c[113]; //= quality_string.c_str();
-    memcpy(quality_string_c, quality_string.c_str(), read_length);
-    for (int p = 40; p < 70; p++) {
+    int32_t num_reads_in_batch = 0;
+    num_reads_per_iteration = batch_controller_size(&read_controller);
+    batch_composition_init(&composition, num_reads_per_iteration);
+    long_reads_init(&long_reads, read_length, kmer_length, num_reads_per_iteration);
+
+    //Reads are packed into read_space in input order and handed to the AFU from composed_space. Every buffer holds
+    //the current batch and is grown between batches when the controller grows it.
+    auto reserve_read_buffers = [&](uint32_t num_reads) -> bool {
+        read_space      = batch_buffer_reserve(accelerator.get(), read_space, &read_space_items, num_reads, 512);
+        composed_space  = batch_buffer_reserve(accelerator.get(), composed_space, &composed_space_items, num_reads, 512);
+        candidate_space = batch_buffer_reserve(accelerator.get(), candidate_space, &candidate_space_items, num_reads, 256 * 32);
+        batch_composition_reserve(&composition, num_reads);
+        long_reads_reserve(&long_reads, num_reads);
+        batch.read_space  = composed_space;
+        batch.write_space = candidate_space;
+        if (!read_space || !composed_space || !candidate_space) {
+            std::cout << "ERROR!!! Cannot allocate space for reads" << std::endl;
+            return false;
+        }
+        if ((max_rounds > 1) && (workspace.capacity < num_reads)) {
+            correction_workspace_free(&workspace);
+            if (!correction_workspace_init(&workspace, accelerator.get(), num_reads)) {
+                std::cout << "ERROR!!! Cannot allocate space for correction rounds" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    };
+    if (!reserve_read_buffers(num_reads_per_iteration)) {
+        fenome::telemetry_stop(&telemetry);
+        return -1;
+    }
+    batch.mode        = fenome::afu_mode::correction;
+    batch.threshold   = 1;
+    batch.levels[0]   = 0;
+    batch.levels[1]   = 20;
+    batch.levels[2]   = 60;
+    batch.levels[3]   = 80;
+    char quality_string_c[MAX_READ_LENGTH + 1]; //= quality_string.c_str();
+    memset(quality_string_c, 'I', read_length);
+    memcpy(quality_string_c, quality_string.c_str(), std::min((int32_t) quality_string.length(), read_length));
+    for (int p = 40; p < 70 && p < read_length; p++) {
         quality_string_c[p] = 0;
     }
-    while (std::getline(test_file, read_string)) {
-        uint32_t start_position, end_position;
-        char read_string_c[113];
-        sscanf(read_string.c_str(), "%s %d %d", read_string_c, &start_position, &end_position); read_string_c[read_length] = '\0';
-        std::cout << "Read : " << read_string_c << " start: " << (char) start_position << " end: " << (char) end_position << std::endl;
+    if (autotune) {
+        struct correction_setting setting;
+        char* sample_space = (char*) accelerator->allocate_buffer(AUTOTUNE_SAMPLE_READS * 512);
+        uint32_t num_sampled = sample_space ? sample_correction_reads(stimulus_file_name, &checkpoint, &kernels, sample_space, AUTOTUNE_SAMPLE_READS) : 0;
+        if (autotune_correction(accelerator.get(), &kernels, sample_space, num_sampled, autotune_target, &setting) >= 0) {
+            batch.threshold = setting.threshold;
+            memcpy(batch.levels, setting.levels, sizeof(batch.levels));
+        }
+        fenome::accelerator::release_buffer(sample_space);
+    }
+    //Run the first num_items composed reads through CORRECTION and write out their records. The accelerator thread
+    //accounts the time on the card; the scans of the candidates and of the rounds go to STAGE_POST_PROCESS and the
+    //writes to STAGE_OUTPUT.
+    auto run_correction_batch = [&](uint32_t num_items, uint64_t* device_ns) -> bool {
+        batch.num_items = num_items;
+        compose_correction_batch(&composition, read_space, composed_space, num_items, batch.threshold, batch.levels);
+        uint64_t device_time = fenome::telemetry_now_ns();
+        fenome::telemetry_add_stage(counters, STAGE_PARSE, device_time - stage_time);
+        fenome::batch_result result = accelerator->submit(batch).get();
+        round_statistics[0].device_ns += result.device_ns;
+        if (!result.success) {
+            std::cout << "ERROR! Read profile doesn't complete!!!" << std::endl;
+            return false;
+        }
+        uint64_t post_process_time = fenome::telemetry_now_ns();
+        *device_ns = post_process_time - device_time;
 
-        memcpy(read_space + 512 * (num_reads_processed % num_reads_per_iteration), read_string_c, read_length);
-        memcpy(read_space + 512 * (num_reads_processed % num_reads_per_iteration) + 256, quality_string_c, read_length);
+        //Windows of long reads aren't reads of their own - the long read is written out and counted once it is stitched
+        uint32_t num_windows = 0;
+        for (uint32_t m = 0; m < num_items; m++) {
+            uint32_t p = composition.position[m];
+            if (long_reads.slot_read[m] >= 0) {
+                num_windows++;
+                continue;
+            }
+            correction_report_add_read(correction_counters, composed_space + p * 512, candidate_space + p * 256 * 32, &kernels, batch.levels);
+        }
+        stage_time = fenome::telemetry_now_ns();
+        fenome::telemetry_add_stage(counters, STAGE_POST_PROCESS, stage_time - post_process_time);
+
+        for (uint32_t m = 0; m < num_items; m++) {
+            if (long_reads.slot_read[m] >= 0) continue;
+            uint32_t p = composition.position[m];
+            char* candidate_local_space = candidate_space + p * 256 * 32;
+            //Items and candidates are not NUL-terminated - at the longest reads the byte after the bases is the item's end position
+            char* read = composed_space + p * 512; int32_t this_read_length = (uint8_t) read[255];
+            int32_t num_candidates = (int32_t) candidate_local_space[255]; //The last byte of every read provides us with the number of candidates
+            //std::cout << "Read " << read << " has " << num_candidates << " candidates" << std::endl;
+            fprintf(output, "Candidate for %.*s is at %lu\n", this_read_length, read, (uint64_t) candidate_local_space);
+            fprintf(output, "Read %.*s has %d candidates\n", this_read_length, read, num_candidates);
+            for (int n = 0; n < num_candidates; n++) {
+                char* candidate = candidate_local_space + n * 256;
+                int32_t num_candidates_to_print = (int32_t) candidate[255];
+                fprintf(output, "Read:%.*s:%.*s:%d\n", this_read_length, read, this_read_length, candidate, num_candidates_to_print);
+            }
+            std::cout << "Completed printing candidates ... " << std::endl;
+        }
+        if (max_rounds > 1) {
+            post_process_time = fenome::telemetry_now_ns();
+            fenome::telemetry_add_stage(counters, STAGE_OUTPUT, post_process_time - stage_time);
+            uint64_t rounds_device_ns = 0;
+            for (uint32_t r = 0; r < max_rounds; r++) {
+                rounds_device_ns -= round_statistics[r].device_ns;
+            }
+            if (run_correction_rounds(accelerator.get(), &workspace, &kernels, &batch, num_items, max_rounds, round_statistics, correction_counters) < 0) {
+                std::cout << "ERROR! Correction rounds don't complete!!!" << std::endl;
+                return false;
+            }
+            for (uint32_t r = 0; r < max_rounds; r++) {
+                rounds_device_ns += round_statistics[r].device_ns;
+            }
+            stage_time = fenome::telemetry_now_ns();
+            *device_ns += rounds_device_ns;
+            fenome::telemetry_add_stage(counters, STAGE_POST_PROCESS, (stage_time - post_process_time) - rounds_device_ns);
+            for (uint32_t m = 0; m < num_items; m++) {
+                if (long_reads.slot_read[m] >= 0) continue;
+                const char* read = composed_space + composition.position[m] * 512;
+                fprintf(output, "Corrected:%.*s\n", (int32_t) (uint8_t) read[255], read);
+            }
+        }
+        uint32_t num_stitched = long_reads_complete_batch(&long_reads, composed_space, candidate_space, composition.position, num_items, &kernels, max_rounds > 1, output);
+        checkpoint.batches_completed++;
+        checkpoint.reads_processed += (num_items - num_windows) + num_stitched;
+        uint64_t output_time = fenome::telemetry_now_ns();
+        fenome::telemetry_add_stage(counters, STAGE_OUTPUT, output_time - stage_time);
+        stage_time = output_time;
+        return true;
+    };
+
+    uint64_t last_checkpoint_batch = checkpoint.batches_completed;
+    stage_time = fenome::telemetry_now_ns();
+    //An iteration packs one item - the next window of a long read if it has windows left, otherwise the next read
+    while (long_reads_pending(&long_reads) || (((uint64_t) test_file.tellg() < checkpoint.input_end) && std::getline(test_file, read_string))) {
+        char* read_item = read_space + 512 * num_reads_in_batch;
+        if (long_reads_pending(&long_reads)) {
+            long_reads_pack_next(&long_reads, &kernels, quality_string_c, read_item, num_reads_in_batch);
+        } else {
+            std::string read_token, read_quality;
+            int32_t start_position, end_position;
+            parse_stimulus_line(read_string, &read_token, &start_position, &end_position, &read_quality);
+            int32_t this_read_length = (int32_t) read_token.length();
+            if (this_read_length < kmer_length) {
+                std::cout << "WARNING! Skipping read shorter than a k-mer : " << read_token << std::endl;
+                continue;
+            }
+            std::cout << "Read : " << read_token << " start: " << (char) start_position << " end: " << (char) end_position << std::endl;
+
+            if (this_read_length > read_length) {
+                if (!long_reads_add(&long_reads, accelerator.get(), &kernels, read_token, read_quality, start_position, end_position)) {
+                    std::cout << "ERROR! Long read windows can't be profiled!!!" << std::endl;
+                    fenome::telemetry_stop(&telemetry);
+                    return -1;
+                }
+                if (!long_reads_pending(&long_reads)) continue;
+                long_reads_pack_next(&long_reads, &kernels, quality_string_c, read_item, num_reads_in_batch);
+            } else {
+                kernels.pack_read(read_item, read_token.c_str(), read_quality.empty() ? quality_string_c : read_quality.c_str(), this_read_length);
+                read_item[254] = start_position;
+                read_item[253] = end_position;
+            }
+        }
 
-        char* read_item = read_space + 512 * (num_reads_processed % num_reads_per_iteration);
- 
-        read_item[255] = read_length;
-        read_item[254] = start_position;
-        read_item[253] = end_position;
-       
         num_reads_processed++;
+        num_reads_in_batch++;
 
-        if (num_reads_processed % num_reads_per_iteration == 0) {
-            set_read_correct_mode(afu_h, num_reads_per_iteration, 1, kmer_length, 0, 20, 60, 80, candidate_space, read_space);
-            Start;
-            bool success = wait_for_idle(afu_h);
-            if (!success) {
-                std::cout << "ERROR! Read profile doesn't complete!!!" << std::endl;
+        if (num_reads_in_batch == num_reads_per_iteration) {
+            uint64_t batch_time = stage_time, device_ns;
+            if (!run_correction_batch(num_reads_per_iteration, &device_ns)) {
+                fenome::telemetry_stop(&telemetry);
                 return -1;
             }
-            clear_status(afu_h);
-
-            for (int m = 0; m < num_reads_per_iteration; m++) {
-                char* candidate_local_space = candidate_space + m * 256 * 32;
-                char* read = read_space + m * 512; read[read_length] = '\0';
-                int32_t num_candidates = (int32_t) candidate_local_space[255]; //The last byte of every read provides us with the number of candidates
-                //std::cout << "Read " << read << " has " << num_candidates << " candidates" << std::endl;
-                printf("Candidate for %s is at %lu\n", read, (uint64_t) candidate_local_space);
-                printf("Read %s has %d candidates\n", read, num_candidates);
-                for (int n = 0; n < num_candidates; n++) {
-                    char* candidate = candidate_local_space + n * 256;
-                    int32_t num_candidates_to_print = (int32_t) candidate[255];
-                    candidate[read_length] = '\0';
-                    //candidate[read_length] = '\0';
-                    printf("Read:%s:%s:%d\n", read,candidate,num_candidates_to_print);
-                }
-                std::cout << "Completed printing candidates ... " << std::endl;
+            //A long read with windows still to pack was consumed from the input, so it can't be checkpointed past
+            if (!checkpoint_file_name.empty() && (checkpoint.batches_completed - last_checkpoint_batch >= CHECKPOINT_INTERVAL_BATCHES) && !long_reads_pending(&long_reads)) {
+                checkpoint_commit(checkpoint_file_name, &checkpoint, output, test_file.eof() ? checkpoint.input_end : (uint64_t) test_file.tellg());
+                last_checkpoint_batch = checkpoint.batches_completed;
             }
+            uint64_t output_time = fenome::telemetry_now_ns();
+            fenome::telemetry_add_stage(counters, STAGE_OUTPUT, output_time - stage_time);
+            batch_controller_update(&read_controller, num_reads_in_batch, (output_time - batch_time) - device_ns, device_ns);
+            num_reads_per_iteration = batch_controller_size(&read_controller);
+            num_reads_in_batch = 0;
+            if (!reserve_read_buffers(num_reads_per_iteration)) {
+                fenome::telemetry_stop(&telemetry);
+                return -1;
+            }
+            stage_time = output_time;
         }
     }
 
-    if (num_reads_processed % num_reads_per_iteration != 0) {
+    if (num_reads_in_batch != 0) {
         std::cout << "Entering the final iteration" << std::endl;
-        set_read_correct_mode(afu_h, num_reads_processed % num_reads_per_iteration, 1, kmer_length, 0, 20, 60, 80, candidate_space, read_space);
-        Start;
-        bool success = wait_for_idle(afu_h);
-        if (!success) {
-            std::cout << "ERROR! Read profile doesn't complete!!!" << std::endl;
+        uint64_t device_ns;
+        if (!run_correction_batch(num_reads_in_batch, &device_ns)) {
+            fenome::telemetry_stop(&telemetry);
             return -1;
         }
-        clear_status(afu_h);
+    }
 
-        for (int m = 0; m < num_reads_processed % num_reads_per_iteration; m++) {
-            char* candidate_local_space = candidate_space + m * 256 * 32;
-            char* read = read_space + m * 512; read[read_length] = '\0';
-            int32_t num_candidates = (int32_t) candidate_local_space[255]; //The last byte of every read provides us with the number of candidates
-            printf("Candidate for %s is at %lu\n", read, (uint64_t) candidate_local_space);
-            printf("Read %s has %d candidates\n", read, num_candidates);
-            for (int n = 0; n < num_candidates; n++) {
-                char* candidate = candidate_local_space + n * 256; 
-                int32_t num_candidates_to_print = (int32_t) candidate[255];
-                candidate[read_length] = '\0';
-                //std::cout << "Read " << read << ":" << candidate << ":" << num_candidates << std::endl;
-                printf("Read:%s:%s:%d\n",read,candidate,num_candidates_to_print);
-            }
-            std::cout << "Completed printing candidates ... " << std::endl;
-        }
+    checkpoint.reads_processed += long_reads_complete_batch(&long_reads, composed_space, candidate_space, composition.position, 0, &kernels, max_rounds > 1, output);
+    if (long_reads.num_reads > 0) {
+        print_long_read_statistics(&long_reads);
+    }
+    long_reads_free(&long_reads);
+
+    if (!checkpoint_file_name.empty()) {
+        checkpoint.complete = true;
+        checkpoint_commit(checkpoint_file_name, &checkpoint, output, checkpoint.input_end);
+    }
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    print_batch_composition_statistics(&composition);
+    correction_report_write(&report, report_file_name);
+    batch_composition_free(&composition);
+
+    if (max_rounds > 1) {
+        print_correction_round_statistics(round_statistics, max_rounds);
+        correction_workspace_free(&workspace);
+    }
+
+    const struct recovery_state& recovery = accelerator->recovery();
+    if (recovery.num_hangs > 0) {
+        std::cout << "Recovered from " << recovery.num_hangs << " hangs with " << recovery.num_resets << " resets, skipped " << recovery.num_bad_items << " reads" << std::endl;
     }
 
-    close_device
+    fenome::telemetry_stop(&telemetry);
+    accelerator.reset();
 
     std::cout << "Closing program ... " << std::endl;
     return 0;
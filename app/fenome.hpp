@@ -5,6 +5,20 @@ extern "C" {
     #include "libcxl.h"
 }
 
+#include "host_kernels.hpp"
+#include "libfenome.hpp"
+
+#include <sched.h>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 //A candidate correction - contains a string representing the correction, a map of the correction, and meta-data regarding it
 struct island_corrections {
     char* read_string;                                //Each candidate 
@@ -28,57 +42,6 @@ struct correction_item {
     int32_t* end_position;
 };
 
-//Shortcut to initialie 2D arrays
-#define allocate(TYPE,var,X,Y) \
-    { \
-        char* space; \
-        var = (TYPE**) malloc(sizeof(TYPE*) * X); \
-        posix_memalign(&space,128,sizeof(TYPE)*X*Y); \
-        for (int i = 0; i < X; i++) { \
-            var[i] = (TYPE*) (space + X * sizeof(TYPE)); \
-        } \
-    }
-
-#define open_device(wed) \
-    struct cxl_afu_h* afu_h; \
-    afu_h = cxl_afu_next(NULL); \
-    if (!afu_h) { \
-        std::cout << "No AFU found!!!" << std::endl; \
-        return -1; \
-    } \
-    afu_h = cxl_afu_open_h(afu_h, CXL_VIEW_DEDICATED); \
-    if (!afu_h) { \
-        std::cout << "Cannot open AFU!!!" << std::endl; \
-        return -1; \
-    } \
-    cxl_afu_attach(afu_h, (uint64_t)wed); \
-    if (cxl_mmio_map(afu_h, CXL_MMIO_LITTLE_ENDIAN) < 0) { \
-        std::cout << "Cannot map MMIO!!!" << std::endl; \
-        return -1; \
-    }
-
-#define close_device \
-    cxl_mmio_unmap(afu_h); \
-    cxl_afu_free(afu_h);
-
-#define FIVE_PRIME 0
-#define BETWEEN 1
-#define THREE_PRIME 2
-#define NO_SOLID 3
-
-//Register addresses
-#define CONTROL        (0x2 << 2)
-#define THRESHOLD      (0x3 << 2)
-#define READ_BASE      (0x4 << 2)
-#define WRITE_BASE     (0x6 << 2)
-#define READS_RECEIVED (0x8 << 2)
-#define READS_WRITTEN  (0x9 << 2)
-#define NUM_ITEMS      (0xa << 2)
-#define START          (0x10 << 2)
-#define RESET          (0x20 << 2)
-#define STATUS         (0x30 << 2)
-#define DDR3_BASE      (0x40 << 2)
-
 //AFU mode 
 #define CORRECTION     2 
 #define SOLID_ISLANDS  1
@@ -90,25 +53,306 @@ struct correction_item {
 //status register
 #define DDR3_INIT_DONE (1 << 5)
 
+//Multi-round correction
+#define MAX_CORRECTION_ROUNDS 8
+
+//Buffers for the re-profiling and compacted correction batches of rounds after the first
+struct correction_workspace {
+    uint32_t  capacity;
+    char*     profile_space;                         //256 bytes per read, SOLID_ISLANDS input
+    int32_t*  index_space;                           //256 bytes per read, SOLID_ISLANDS output
+    char*     compact_space;                         //512 bytes per read, the residual reads of a round
+    char*     candidate_space;                       //256 * 32 bytes per read
+    uint32_t* pending;                               //Item in read_space of each compacted read
+    bool*     changed;
+};
+
+struct correction_round_statistics {
+    uint64_t reads_submitted;
+    uint64_t reads_with_candidates;
+    uint64_t reads_changed;
+    uint64_t reads_solid;                            //Fully solid after this round's corrections
+    uint64_t device_ns;
+};
+
+//Batch composition - NUM_UNITS in correctErrorsWrapped.v
+#define NUM_CORRECTION_UNITS        4
+#define CORRECTION_COST_BASE        8                //Fixed cost of a read - fetch, 1st k-mer check, candidate write-back
+#define CORRECTION_COST_LOW_QUALITY 3                //Extra cost of a low quality base inside the correction span
+
+//Per-batch cost estimates and the layout of the read items handed to the AFU, plus run totals
+struct batch_composition {
+    uint32_t capacity;
+    uint32_t* cost;                                  //Estimated cost of each read, in input order
+    uint32_t* order;                                 //Input read at each position of the composed batch
+    uint32_t* position;                              //Position of each input read in the composed batch
+    uint64_t num_batches;
+    uint64_t num_reads;
+    uint64_t max_cost;
+    double   input_order_busy_sum;                   //Sum over batches of the utilisation under the p % NUM_CORRECTION_UNITS model
+    double   composed_busy_sum;
+};
+
+//Checkpoint/resume and sharding
+#define CHECKPOINT_INTERVAL_BATCHES 16               //Batches between checkpoints - each one syncs the output
+
+//Progress of a run (or of one shard of a split run) over the stimulus file
+struct run_checkpoint {
+    std::string input_file_name;
+    uint32_t    shard_index;
+    uint32_t    num_shards;
+    uint64_t    input_offset;                        //First input byte not yet covered by committed output
+    uint64_t    input_end;                           //End of this shard's byte range
+    uint64_t    batches_completed;
+    uint64_t    reads_processed;
+    uint64_t    output_offset;                       //Output bytes committed up to input_offset
+    bool        complete;
+};
+
+//Telemetry
+#define CACHE_LINE_SIZE          128                 //POWER8 cache line
+#define TELEMETRY_MAX_THREADS    64
+#define TELEMETRY_LATENCY_BUCKETS 24                 //log2 buckets of batch latency in microseconds
+#define TELEMETRY_INTERVAL_MS    1000
+#define TELEMETRY_MODES          3                   //Items are counted per AFU mode - PROGRAM, SOLID_ISLANDS, CORRECTION
+
+//Adaptive batch sizing
+#define BATCH_MEMORY_BUDGET           (256 << 20)    //Bytes of pinned host buffers available for one batch
+#define BATCH_CONTROLLER_WINDOW       4              //Batches measured at one size before moving
+#define BATCH_CONTROLLER_INITIAL_STEP 2.0            //Multiplicative step
+#define BATCH_CONTROLLER_MIN_STEP     1.125
+#define BATCH_CONTROLLER_TOLERANCE    0.02           //Relative improvement needed to keep going in the same direction
+#define MIN_READS_PER_ITERATION       64
+#define MIN_KMERS_PER_ITERATION       256
+#define READ_ITEM_GRANULARITY         2              //set_read_profile_mode : reads go in pairs
+#define KMER_ITEM_GRANULARITY         8              //set_kmer_program_mode : even number of 4-kmer items
+#define READ_ITEM_BYTES               (512 + 512 + 256 * 32) //read_space + composed_space + candidate_space per read
+#define READ_ROUND_ITEM_BYTES         (256 + 256 + 512 + 256 * 32) //correction_workspace per read, with -n above 1
+#define KMER_ITEM_BYTES               64
+
+//Batch size controller for one kind of AFU workload
+struct batch_controller {
+    const char* name;
+    uint32_t granularity;
+    uint32_t min_items;
+    uint32_t max_items;
+    uint32_t current;
+    double   step;
+    int32_t  direction;
+    double   last_throughput;                        //Items per second measured at the previous size
+    uint32_t window_batches;
+    uint64_t window_items;
+    uint64_t window_ns;
+};
+
+//Hang detection and recovery
+#define WATCHDOG_STALL_MS            10000           //A batch without progress for this long is considered hung
+#define WATCHDOG_POLL_INTERVAL       4096            //STATUS polls between progress checks
+#define RECOVERY_MAX_RETRIES         2               //Retries of a batch before it is bisected
+#define RECOVERY_KMERS_PER_ITERATION 2048            //Batch size used to restore the filter after a reset
+
+//Incremental filter updates - CBF_WIDTH bcbf is instantiated with in top/bloom_filter_wrapper.sv
+#define CBF_COUNTER_WIDTH              1
+#define CBF_COUNTER_MAX                ((1 << CBF_COUNTER_WIDTH) - 1)
+#define KMER_DELTA_KMERS_PER_ITERATION 8192
+#define KMER_DELTA_REBUILD_FRACTION    0.05          //Rebuild once this fraction of the resident k-mers is retired
+
+//A k-mer packed 2 bits per base
+struct kmer_key {
+    uint64_t high;
+    uint64_t low;
+    bool operator==(const kmer_key& other) const { return (high == other.high) && (low == other.low); }
+};
+
+struct kmer_key_hash {
+    size_t operator()(const kmer_key& key) const { return (size_t) ((key.high * 0x9e3779b97f4a7c15ull) ^ key.low ^ (key.low >> 29)); }
+};
+
+//The k-mers in the filter and the number of times each has been programmed
+struct resident_kmers {
+    std::unordered_map<kmer_key, uint8_t, kmer_key_hash> counts;
+    std::unordered_set<kmer_key, kmer_key_hash> retired_pending;   //Count dropped to 0, still set in the filter
+    int32_t  kmer_length;
+    uint64_t num_saturated;                          //k-mers programmed CBF_COUNTER_MAX times
+    uint64_t num_retired;
+};
+
+struct kmer_delta_statistics {
+    uint64_t num_added;
+    uint64_t num_removed;
+    uint64_t num_saturated;                          //Additions not sent because the k-mer was already at the limit
+    uint64_t num_not_resident;                       //Removals of k-mers that weren't in the filter
+    uint64_t num_invalid;
+    bool     rebuilt;
+};
+
+//A unit of AFU work - everything needed to issue it again (or a part of it) after a reset
+struct afu_batch {
+    uint32_t mode;                                   //PROGRAM, SOLID_ISLANDS or CORRECTION
+    uint32_t num_items;
+    char*    read_space;
+    char*    write_space;
+    uint8_t  threshold;
+    uint8_t  levels[4];
+};
+
+//State needed to bring the AFU back after a hang
+struct recovery_state {
+    fenome::device* afu;
+    int32_t     kmer_length;
+    std::string kmer_file_name;
+    uint64_t    num_kmers_programmed;                //k-mers resident in the filter - replayed after a reset
+    char*       kmer_space;                          //Private space for the replay
+    uint32_t    kmer_space_items;
+    bool        restore_filter_on_reset;             //Replay after a reset - the filter lives in DDR3, which only DDR3_INIT clears, but a hang can leave it half programmed
+    struct resident_kmers* resident_kmers;           //If set, replayed instead of kmer_file_name - tracks k-mer deltas
+    uint32_t    stall_ms;
+    uint32_t    max_retries;
+    uint32_t    num_hangs;
+    uint32_t    num_resets;
+    uint32_t    num_bad_items;
+};
+
+//Host pipeline stages for which busy time is accounted
+enum telemetry_stage {
+    STAGE_PARSE = 0,                                  //Reading input and packing items into read_space/kmer_space
+    STAGE_DEVICE,                                     //From Start till the AFU reports idle
+    STAGE_POST_PROCESS,                               //Scanning candidate_space/index_space
+    STAGE_OUTPUT,                                     //Writing results
+    NUM_STAGES
+};
+
+//Counters owned by a single thread - only that thread writes them, the sampler reads them.
+//Each block is padded to a cache line so that the owners don't false-share.
+struct alignas(CACHE_LINE_SIZE) telemetry_counters {
+    std::atomic<uint64_t> stage_busy_ns[NUM_STAGES];
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> items[TELEMETRY_MODES];     //k-mers programmed, reads profiled, reads corrected
+    std::atomic<uint64_t> batch_latency_ns;
+    std::atomic<uint64_t> batch_latency_max_ns;
+    std::atomic<uint64_t> batch_latency_histogram[TELEMETRY_LATENCY_BUCKETS];
+    std::atomic<int64_t>  queue_depth;
+    char name[32];
+};
+
+//Telemetry state for a run - per-thread counters, the last device sample and the sampler thread
+struct telemetry_state {
+    struct telemetry_counters threads[TELEMETRY_MAX_THREADS];
+    std::atomic<int32_t>  num_threads;
+    const fenome::device* afu;
+    std::atomic<uint32_t> status;
+    std::atomic<uint32_t> reads_received;
+    std::atomic<uint32_t> reads_written;
+    std::atomic<uint64_t> num_samples;
+    std::atomic<bool>     running;
+    std::thread           sampler;
+    std::string           metrics_file_name;
+    std::string           summary_file_name;
+    uint32_t              interval_ms;
+    uint64_t              start_time_ns;
+};
+
+//Correction report
+#define NUM_ISLAND_TYPES 4                           //FIVE_PRIME, BETWEEN, THREE_PRIME, NO_SOLID
+
+//Counters owned by a single thread and only read after it is done, so they are plain integers.
+//Aligned to a cache line so that neighbouring blocks don't false-share.
+struct alignas(CACHE_LINE_SIZE) correction_counters {
+    uint64_t reads;
+    uint64_t reads_corrected;                        //Best candidate differs from the read
+    uint64_t reads_uncorrectable;                    //No candidates
+    uint64_t reads_untouched;                        //Best candidate is the read itself
+    uint64_t candidates_per_read[33];
+    uint64_t island_types[NUM_ISLAND_TYPES];
+    uint64_t substitutions_by_position[MAX_READ_LENGTH];
+    uint64_t substitutions_by_quality[4];            //By 2-bit quality level, as compressQualityScore.v computes it
+    uint64_t bases_by_quality[4];                    //Bases of corrected reads by quality level - the denominators
+    uint64_t kmers_queried;                          //From SOLID_ISLANDS profiles
+    uint64_t kmers_solid;
+};
+
+struct correction_report {
+    struct correction_counters threads[TELEMETRY_MAX_THREADS];
+    std::atomic<int32_t> num_threads;
+};
+
+//Profiling-only mode
+#define PROFILE_READS_PER_ITERATION 4096             //Per buffer set - two sets are in flight
+
+//QC metrics of a profiling run
+struct profile_qc {
+    uint64_t reads;
+    uint64_t reads_no_solid;                         //No solid k-mer at all - contamination or adapter
+    uint64_t reads_fully_solid;
+    uint64_t reads_too_short;
+    uint64_t reads_windowed;                         //Longer than the run's read length, profiled as overlapping windows
+    uint64_t reads_truncated;                        //Longer than MAX_READ_LENGTH, profiled over their first MAX_READ_LENGTH bases
+    uint64_t bases;
+    uint64_t solid_bases;                            //Covered by at least one solid k-mer
+    uint64_t islands_per_read[33];
+    uint64_t bases_by_cycle[MAX_READ_LENGTH];
+    uint64_t non_solid_by_cycle[MAX_READ_LENGTH];
+};
+
+//Auto-tuning of the correction levels
+#define AUTOTUNE_SAMPLE_READS 2048                   //Reads in the reservoir sample
+#define AUTOTUNE_SCAN_READS (1 << 20)                //Reads the sample is drawn from - bounds the extra pass over the input
+#define AUTOTUNE_RELATIVE_TARGET 0.95                //Without a target, accept settings correcting this share of the best
+
+//Quality levels and threshold of a CORRECTION batch
+struct correction_setting {
+    uint8_t threshold;
+    uint8_t levels[4];
+};
+
+struct autotune_result {
+    double candidates_per_read;
+    double device_ns_per_read;
+    double corrected_fraction;
+};
+
+//Reads longer than the run's read length are corrected as overlapping windows of that length
+struct long_read_window {
+    int32_t offset;
+    int32_t start_position;                          //Coordinates carried by the window's item
+    int32_t end_position;
+    bool    submitted;                               //Windows known to be solid keep the read as it is
+    std::string corrected;
+};
+
+struct long_read {
+    std::string read;
+    std::string quality;                             //Empty if the stimulus line had none
+    std::vector<struct long_read_window> windows;
+    uint32_t next_window;                            //Next window to pack
+    uint32_t num_received;
+};
+
+struct long_reads {
+    int32_t  window_length;
+    int32_t  overlap;                                //A k-mer, so every k-mer of the read lies whole in some window
+    int32_t  kmer_length;
+    uint64_t first_id;                               //Id of reads.front()
+    std::deque<struct long_read> reads;              //Waiting for windows, in input order
+    std::vector<int64_t>  slot_read;                 //Long read the item in each batch slot belongs to, -1 for ordinary reads
+    std::vector<uint32_t> slot_window;
+    char*    profile_space;                          //SOLID_ISLANDS items of the windows past the stimulus' region
+    char*    index_space;
+    uint32_t profile_space_items;
+    uint32_t index_space_items;
+    uint64_t num_reads;
+    uint64_t num_windows;
+    uint64_t num_windows_profiled;
+    uint64_t num_windows_skipped;
+    uint64_t num_conflicts;                          //Overlap bases the neighbouring windows corrected differently
+    uint64_t num_reads_with_conflicts;
+};
+
 //Register fields
 #define SetControlRegister(mode,threshold,kmerlength) ((mode & 7) | ((threshold & 3) << 3) | ((kmerlength & 0xff) << 8))
 #define SetThresholdsLevels(level0,level1,level2,level3) (((level3 & 0xff) << 24) | ((level2 & 0xff) << 16) | ((level1 & 0xff) << 8) | (level0 & 0xff))
-#define Start cxl_mmio_write32(afu_h,START,0xdead)
-#define Reset cxl_mmio_write32(afu_h,RESET,0xdead)
 
 //Function prototypes
-void inline set_kmer_program_mode(struct cxl_afu_h* afu_h ,uint32_t num_kmers_per_payload, int32_t kmer_length, char* kmer_space);
-                                                     //Set AFU to do solid k-mer programming
-void inline set_read_profile_mode(struct cxl_afu_h* afu_h, uint32_t num_reads_per_payload, int32_t kmer_length, int32_t* index_space, char* read_space);
-                                                     //Set AFU to do profiling of the reads and return the maps
-void inline set_read_correct_mode(struct cxl_afu_h* afu_h, uint32_t num_reads_per_payload, uint8_t threshold, int32_t kmer_length, uint8_t level0, uint8_t level1, uint8_t level2, uint8_t level3, char* candidate_space, char* read_space);
-                                                     //Set AFU to do error correction of reads and return candidates
-bool inline wait_for_idle(struct cxl_afu_h* afu_h, int32_t total_wait_cycles);
-                                                     //Wait for AFU operations to complete
-bool inline wait_for_ddr3_init(struct cxl_afu_h*);
-                                                     //Put DDR3 in init mode and poll to see whether init is done
-void inline clear_status(struct cxl_afu_h* afu_h);
-                                                     //Clear the status register
 void adjust_solid_islands(int32_t** index_space, uint32_t num_items);
                                                      //Code to adjust solid island space - reused from GENE
 int set_correction_types(struct correction_item* correction_array, uint32_t num_items, uint32_t** candidate_space, uint32_t** correction_space);
@@ -117,3 +361,147 @@ void set_correction_map(struct correction_item* correction_array, uint32_t num_i
                                                      //Function runs through each item and fixes the candidate map for each candidate
 void post_process_corrections(struct correction_item* correction_array, uint32_t num_items);
                                                      //Do post processing on candidates - reused from GENE
+void batch_controller_init(struct batch_controller* controller, const char* name, uint32_t initial_items, uint32_t min_items, uint32_t granularity, uint64_t bytes_per_item, uint64_t memory_budget);
+                                                     //Bound the batch size by the memory budget and the AFU item granularity
+uint32_t inline batch_controller_size(struct batch_controller* controller);
+                                                     //Number of items to collect for the next batch
+uint32_t inline batch_controller_capacity(struct batch_controller* controller);
+                                                     //Largest batch the controller will ever ask for
+char* batch_buffer_reserve(fenome::accelerator* accelerator, char* space, uint32_t* capacity, uint32_t num_items, uint64_t bytes_per_item);
+                                                     //Grow a batch buffer to hold num_items items - its contents are not kept
+void batch_controller_update(struct batch_controller* controller, uint32_t num_items, uint64_t host_ns, uint64_t device_ns);
+                                                     //Feed back the time spent on a batch and possibly move the batch size
+bool correction_workspace_init(struct correction_workspace* workspace, fenome::accelerator* accelerator, uint32_t capacity);
+                                                     //Allocate the buffers for later correction rounds on the card's node
+void correction_workspace_free(struct correction_workspace* workspace);
+                                                     //Release them
+int32_t run_correction_rounds(fenome::accelerator* accelerator, struct correction_workspace* workspace, const struct host_kernels* kernels, const fenome::batch* correction_batch, uint32_t num_reads, uint32_t max_rounds, struct correction_round_statistics* statistics, struct correction_counters* counters);
+                                                     //Apply the first pass and run further rounds on the residual reads, accounting the re-profiles - returns the rounds used, -1 on failure
+void print_correction_round_statistics(const struct correction_round_statistics* statistics, uint32_t max_rounds);
+                                                     //Per-round summary
+uint32_t estimate_correction_cost(const char* read_item, uint8_t threshold, const uint8_t* levels);
+                                                     //Relative AFU time a read item is expected to take in CORRECTION mode
+bool batch_composition_init(struct batch_composition* composition, uint32_t capacity);
+                                                     //Allocate the per-read arrays
+void batch_composition_reserve(struct batch_composition* composition, uint32_t capacity);
+                                                     //Grow them, keeping the statistics
+void batch_composition_free(struct batch_composition* composition);
+                                                     //Release them
+void compose_correction_batch(struct batch_composition* composition, const char* read_space, char* composed_space, uint32_t num_reads, uint8_t threshold, const uint8_t* levels);
+                                                     //Copy the reads to composed_space in an order that balances the correction units
+void print_batch_composition_statistics(const struct batch_composition* composition);
+                                                     //Utilisation under the dispatch model - not a measurement
+struct correction_counters* correction_report_register_thread(struct correction_report* report);
+                                                     //Hand out a counter block to the calling thread
+void correction_report_add_read(struct correction_counters* counters, const char* read_item, const char* candidate_local_space, const struct host_kernels* kernels, const uint8_t* levels);
+                                                     //Account the outcome of correcting one read
+void correction_report_add_profile(struct correction_counters* counters, const int32_t* index_base, int32_t read_length, int32_t kmer_length);
+                                                     //Account the Bloom filter answers for one profiled read
+bool correction_report_write(struct correction_report* report, const std::string& report_file_name);
+                                                     //Merge the thread blocks and write the JSON report
+int32_t run_profiling(fenome::accelerator* accelerator, const struct host_kernels* kernels, std::ifstream& input, struct run_checkpoint* checkpoint, const std::string& checkpoint_file_name, FILE* output, struct profile_qc* qc, struct correction_counters* counters, struct telemetry_counters* telemetry);
+                                                     //Stream the input through SOLID_ISLANDS and write an island record per read
+bool profile_qc_write(const struct profile_qc* qc, const std::string& qc_file_name);
+                                                     //Write the QC metrics as JSON
+uint32_t sample_correction_reads(const std::string& stimulus_file_name, const struct run_checkpoint* checkpoint, const struct host_kernels* kernels, char* sample_space, uint32_t capacity);
+                                                     //Reservoir sample of the reads in the input range that carry qualities, packed as correction items
+int32_t autotune_correction(fenome::accelerator* accelerator, const struct host_kernels* kernels, const char* sample_space, uint32_t num_reads, double target_fraction, struct correction_setting* chosen);
+                                                     //Correct the sample with every setting and pick the cheapest one meeting the target
+void long_reads_init(struct long_reads* long_reads, int32_t window_length, int32_t kmer_length, uint32_t capacity);
+                                                     //Window geometry and one slot entry per item of the batch
+void long_reads_reserve(struct long_reads* long_reads, uint32_t capacity);
+                                                     //Slot entries for a larger batch - call between batches
+bool long_reads_add(struct long_reads* long_reads, fenome::accelerator* accelerator, const struct host_kernels* kernels, const std::string& read, const std::string& quality, int32_t start_position, int32_t end_position);
+                                                     //Split a long read into windows, carrying its island coordinates into them and profiling the windows they don't cover - false on device failure
+bool long_reads_pending(const struct long_reads* long_reads);
+                                                     //Whether the last long read still has windows to pack
+void long_reads_pack_next(struct long_reads* long_reads, const struct host_kernels* kernels, const char* quality, char* read_item, uint32_t slot);
+                                                     //Pack the next window of the last long read into a batch slot - quality is used if the read has none
+uint32_t long_reads_complete_batch(struct long_reads* long_reads, const char* composed_space, const char* candidate_space, const uint32_t* position, uint32_t num_items, const struct host_kernels* kernels, bool rounds_applied, FILE* output);
+                                                     //Collect the corrected windows of a batch and write the long reads that are complete - returns how many
+void print_long_read_statistics(const struct long_reads* long_reads);
+                                                     //Windows per read and overlap conflicts
+void long_reads_free(struct long_reads* long_reads);
+                                                     //Release the profiling buffers
+bool parse_stimulus_line(const std::string& line, std::string* read, int32_t* start_position, int32_t* end_position, std::string* quality);
+                                                     //Split a stimulus line into the read, its island coordinates and its qualities if it has them
+bool shard_byte_range(const std::string& input_file_name, uint32_t shard_index, uint32_t num_shards, uint64_t* start, uint64_t* end);
+                                                     //Record-aligned byte range of one shard of the input
+void checkpoint_init(struct run_checkpoint* checkpoint, const std::string& input_file_name, uint32_t shard_index, uint32_t num_shards, uint64_t input_offset, uint64_t input_end);
+                                                     //Fresh checkpoint for a run over a byte range
+bool checkpoint_load(const std::string& checkpoint_file_name, struct run_checkpoint* checkpoint);
+                                                     //Read a checkpoint - false if there is none
+bool checkpoint_save(const std::string& checkpoint_file_name, const struct run_checkpoint* checkpoint);
+                                                     //Atomically replace the checkpoint file
+bool checkpoint_commit(const std::string& checkpoint_file_name, struct run_checkpoint* checkpoint, FILE* output, uint64_t input_offset);
+                                                     //Sync the output and checkpoint the progress it covers
+FILE* checkpoint_open_output(const std::string& output_file_name, const struct run_checkpoint* checkpoint, bool resume);
+                                                     //Open the output, truncated to the checkpoint when resuming
+int32_t merge_shard_outputs(const std::string& merged_file_name, char** shard_file_names, int32_t num_files);
+                                                     //Concatenate completed shard outputs in shard order
+
+//libfenome internals and the parts of it fenome.cpp uses - defined in the files libfenome.cpp includes
+namespace fenome {
+
+void inline set_kmer_program_mode(device& afu, uint32_t num_kmers_per_payload, int32_t kmer_length, char* kmer_space);
+                                                     //Set AFU to do solid k-mer programming
+void inline set_read_profile_mode(device& afu, uint32_t num_reads_per_payload, int32_t kmer_length, int32_t* index_space, char* read_space);
+                                                     //Set AFU to do profiling of the reads and return the maps
+void inline set_read_correct_mode(device& afu, uint32_t num_reads_per_payload, uint8_t threshold, int32_t kmer_length, uint8_t level0, uint8_t level1, uint8_t level2, uint8_t level3, char* candidate_space, char* read_space);
+                                                     //Set AFU to do error correction of reads and return candidates
+bool inline wait_for_ddr3_init(device& afu);
+                                                     //Put DDR3 in init mode and poll to see whether init is done
+bool kmer_key_from_string(const char* kmer, int32_t kmer_length, struct kmer_key* key);
+                                                     //Pack a k-mer - false if it has bases other than ACGT
+void resident_kmers_init(struct resident_kmers* resident, int32_t kmer_length);
+                                                     //Empty resident set
+bool resident_kmers_load(struct resident_kmers* resident, const std::string& kmer_file_name);
+                                                     //Account the k-mers the filter was programmed from
+void resident_kmers_add_padding(struct resident_kmers* resident, const std::string& first_kmer, uint32_t num_kmers);
+                                                     //Account the copies of its first k-mer set_kmer_program_mode pads a batch with
+bool replay_resident_kmers(struct recovery_state* recovery);
+                                                     //Program the resident set into a cleared filter
+bool rebuild_filter(struct recovery_state* recovery);
+                                                     //Reset, clear the filter memory and replay the resident set
+int32_t apply_kmer_delta(accelerator* accelerator, struct resident_kmers* resident, const struct host_kernels* kernels, const std::string& add_file_name, const std::string& remove_file_name, struct kmer_delta_statistics* statistics);
+                                                     //Retire and add k-mers, rebuilding the filter when enough are retired
+void print_kmer_delta_statistics(const struct resident_kmers* resident, const struct kmer_delta_statistics* statistics);
+                                                     //Summary of a delta and of the counter saturation
+bool inline wait_for_idle_watchdog(device& afu, uint32_t stall_ms);
+                                                     //Wait for AFU operations to complete, fail if READS_RECEIVED/READS_WRITTEN stop moving
+void inline issue_batch(device& afu, int32_t kmer_length, struct afu_batch* batch);
+                                                     //Program the registers for a batch and Start
+void recovery_init(struct recovery_state* recovery, device* afu, int32_t kmer_length, const std::string& kmer_file_name);
+                                                     //Set up recovery for a run
+bool restore_filter(struct recovery_state* recovery);
+                                                     //Re-program the k-mers programmed so far
+bool reset_afu(struct recovery_state* recovery);
+                                                     //Reset the AFU and restore the filter
+int32_t run_batch(struct recovery_state* recovery, struct afu_batch* batch);
+                                                     //Run a batch with retries and bisection - returns the number of skipped items, -1 if the AFU is lost
+int32_t afu_numa_node(struct cxl_afu_h* afu_h);
+                                                     //NUMA node of the card's PCI slot, -1 if unknown
+int32_t numa_num_nodes();
+                                                     //Number of NUMA nodes on the host
+bool numa_node_cpus(int32_t node, cpu_set_t* cpus);
+                                                     //CPUs belonging to a node
+bool pin_thread_to_node(int32_t node);
+                                                     //Restrict the calling thread to a node's CPUs
+void* numa_alloc_on_node(size_t bytes, int32_t node);
+                                                     //Page aligned, pre-faulted buffer preferring the node - release with free()
+uint64_t telemetry_now_ns();
+                                                     //Monotonic time stamp in nanoseconds
+void telemetry_start(struct telemetry_state* telemetry, const device* afu, const std::string& metrics_file_name, const std::string& summary_file_name, uint32_t interval_ms);
+                                                     //Start the sampler thread which periodically rewrites the metrics file
+struct telemetry_counters* telemetry_register_thread(struct telemetry_state* telemetry, const char* name);
+                                                     //Hand out a cache-line padded counter block to the calling thread
+void telemetry_add_stage(struct telemetry_counters* counters, enum telemetry_stage stage, uint64_t busy_ns);
+                                                     //Account busy time to a stage
+void telemetry_add_batch(struct telemetry_counters* counters, uint32_t mode, uint32_t num_items, uint64_t latency_ns);
+                                                     //Account a completed batch of an AFU mode
+void telemetry_set_queue_depth(struct telemetry_counters* counters, int64_t depth);
+                                                     //Publish the depth of the queue owned by this thread
+void telemetry_stop(struct telemetry_state* telemetry);
+                                                     //Stop the sampler, write the final metrics and the JSON summary
+
+}
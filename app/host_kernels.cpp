@@ -0,0 +1,121 @@
+//Host-side packing and scanning kernels. Each kernel is a template over a length bucket so that its loop has
+//a compile-time trip count and can be fully unrolled and vectorized; positions past the real length are masked.
+//select_host_kernels picks the instantiation for the k-mer and read lengths of the run once, up front.
+
+static inline uint32_t is_nucleotide(char base) {
+    return (base == 'A') | (base == 'C') | (base == 'G') | (base == 'T');
+}
+
+//One k-mer into a 64-byte kmer_space slot. Lower case is folded, the rest of the slot is cleared.
+template <int32_t KMER_BUCKET>
+static bool pack_kmer_kernel(char* slot, const char* kmer, int32_t kmer_length) {
+    uint32_t num_invalid = 0;
+    for (int32_t i = 0; i < KMER_BUCKET; i++) {
+        char base = (i < kmer_length) ? (char) (kmer[i] & 0xdf) : 0;
+        num_invalid += (i < kmer_length) & !is_nucleotide(base);
+        slot[i] = base;
+    }
+    if (KMER_BUCKET < 64) {
+        memset(slot + KMER_BUCKET, 0, 64 - KMER_BUCKET);
+    }
+    return num_invalid == 0;
+}
+
+//One read and its quality string into a 512-byte correction item. Bases the AFU can't encode (N and friends)
+//get quality 0 so they are always treated as low quality. Returns the number of such bases.
+template <int32_t READ_BUCKET>
+static int32_t pack_read_kernel(char* read_item, const char* read, const char* quality, int32_t read_length) {
+    char* quality_item = read_item + 256;
+    int32_t num_invalid = 0;
+    for (int32_t i = 0; i < READ_BUCKET; i++) {
+        char base     = (i < read_length) ? (char) (read[i] & 0xdf) : 0;
+        char score    = (i < read_length) ? quality[i] : 0;
+        uint32_t bad  = (i < read_length) & !is_nucleotide(base);
+        num_invalid  += bad;
+        read_item[i]    = base;
+        quality_item[i] = bad ? 0 : score;
+    }
+    read_item[255] = read_length;
+    return num_invalid;
+}
+
+//One read into a 256-byte SOLID_ISLANDS item - bases only, the length in the last byte
+template <int32_t READ_BUCKET>
+static int32_t pack_profile_kernel(char* read_item, const char* read, int32_t read_length) {
+    int32_t num_invalid = 0;
+    for (int32_t i = 0; i < READ_BUCKET; i++) {
+        char base    = (i < read_length) ? (char) (read[i] & 0xdf) : 0;
+        num_invalid += (i < read_length) & !is_nucleotide(base);
+        read_item[i] = base;
+    }
+    read_item[255] = read_length;
+    return num_invalid;
+}
+
+//Number of substitutions between a candidate and its read. Both live in 256-byte slots, so the whole bucket can be read.
+template <int32_t READ_BUCKET>
+static int32_t count_differences_kernel(const char* candidate, const char* read, int32_t read_length) {
+    int32_t num_differences = 0;
+    for (int32_t i = 0; i < READ_BUCKET; i++) {
+        num_differences += (i < read_length) & (candidate[i] != read[i]);
+    }
+    return num_differences;
+}
+
+template <int32_t KMER_BUCKET>
+static void select_read_kernels(struct host_kernels* kernels, int32_t read_length) {
+    kernels->pack_kmer = pack_kmer_kernel<KMER_BUCKET>;
+    if (read_length <= 64) {
+        kernels->pack_read         = pack_read_kernel<64>;
+        kernels->pack_profile      = pack_profile_kernel<64>;
+        kernels->count_differences = count_differences_kernel<64>;
+        kernels->read_bucket       = 64;
+    } else if (read_length <= 128) {
+        kernels->pack_read         = pack_read_kernel<128>;
+        kernels->pack_profile      = pack_profile_kernel<128>;
+        kernels->count_differences = count_differences_kernel<128>;
+        kernels->read_bucket       = 128;
+    } else if (read_length <= 192) {
+        kernels->pack_read         = pack_read_kernel<192>;
+        kernels->pack_profile      = pack_profile_kernel<192>;
+        kernels->count_differences = count_differences_kernel<192>;
+        kernels->read_bucket       = 192;
+    } else {
+        kernels->pack_read         = pack_read_kernel<253>;
+        kernels->pack_profile      = pack_profile_kernel<253>;
+        kernels->count_differences = count_differences_kernel<253>;
+        kernels->read_bucket       = 253;
+    }
+}
+
+namespace fenome {
+
+bool select_host_kernels(struct host_kernels* kernels, int32_t kmer_length, int32_t read_length) {
+    if ((kmer_length < MIN_KMER_LENGTH) || (kmer_length > MAX_KMER_LENGTH)) {
+        std::cout << "k-mer length " << kmer_length << " is outside [" << MIN_KMER_LENGTH << "," << MAX_KMER_LENGTH << "]" << std::endl;
+        return false;
+    }
+    if ((read_length < kmer_length) || (read_length > MAX_READ_LENGTH)) {
+        std::cout << "Read length " << read_length << " is outside [" << kmer_length << "," << MAX_READ_LENGTH << "]" << std::endl;
+        return false;
+    }
+
+    kernels->kmer_length = kmer_length;
+    kernels->read_length = read_length;
+    if (kmer_length <= 16) {
+        kernels->kmer_bucket = 16;
+        select_read_kernels<16>(kernels, read_length);
+    } else if (kmer_length <= 32) {
+        kernels->kmer_bucket = 32;
+        select_read_kernels<32>(kernels, read_length);
+    } else if (kmer_length <= 48) {
+        kernels->kmer_bucket = 48;
+        select_read_kernels<48>(kernels, read_length);
+    } else {
+        kernels->kmer_bucket = 64;
+        select_read_kernels<64>(kernels, read_length);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,46 @@
+//Host-side kernels and the read item conventions they share - no libcxl, so tools that only run the kernels
+//(microbench.cpp) build without the CAPI headers.
+#ifndef HOST_KERNELS_HPP
+#define HOST_KERNELS_HPP
+
+#include <stdint.h>
+
+#define FIVE_PRIME 0
+#define BETWEEN 1
+#define THREE_PRIME 2
+#define NO_SOLID 3
+#define SOLID_READ -1
+
+//Supported lengths - MIN_KMER_WIDTH in afu.v, kmerLength is a 6-bit field in pslMMIO.v, and the last three
+//bytes of a read item carry the length and the island coordinates
+#define MIN_KMER_LENGTH 12
+#define MAX_KMER_LENGTH 63
+#define MAX_READ_LENGTH 253
+
+//Packing and scanning kernels specialized for the k-mer and read length buckets of a run
+struct host_kernels {
+    int32_t kmer_length;
+    int32_t read_length;                             //Longest read of the run
+    int32_t kmer_bucket;
+    int32_t read_bucket;
+    bool    (*pack_kmer)(char* slot, const char* kmer, int32_t kmer_length);
+    int32_t (*pack_read)(char* read_item, const char* read, const char* quality, int32_t read_length);
+    int32_t (*pack_profile)(char* read_item, const char* read, int32_t read_length);
+    int32_t (*count_differences)(const char* candidate, const char* read, int32_t read_length);
+};
+
+int32_t classify_read_islands(const int32_t* index_base, int32_t read_length, int32_t kmer_length, int32_t* start_position, int32_t* end_position);
+                                                     //Type and k-mer range of the first non-solid island of a profiled read, SOLID_READ if there is none
+int32_t island_type_from_coordinates(int32_t start_position, int32_t end_position, int32_t read_length);
+                                                     //Type of the island a read item's coordinates describe
+int32_t choose_candidate(const char* candidate_local_space, const char* read, int32_t read_length, const struct host_kernels* kernels);
+                                                     //Index of the candidate with the fewest substitutions, -1 if there are none
+
+namespace fenome {
+
+bool select_host_kernels(struct host_kernels* kernels, int32_t kmer_length, int32_t read_length);
+                                                     //Validate the lengths and pick the kernel instantiations for them
+
+}
+
+#endif
@@ -0,0 +1,267 @@
+//Incremental Bloom filter updates. The host keeps the k-mers resident in the filter with the count each one has
+//been programmed with. Added k-mers are programmed as PROGRAM batches of just the delta - each one increments its
+//counters in bcbf.v, which saturate at CBF_COUNTER_MAX, so a k-mer already at that count is not sent again. The
+//top level instantiates bcbf with 1-bit counters, so that is a single copy. A batch that isn't a multiple of 8
+//k-mers is padded with copies of its first one, and those copies are counted like any other.
+//bcbf.v has no decrement path, so a removal only lowers the host count; once enough k-mers have been retired the
+//filter is cleared (DDR3_INIT zeroes the memory it lives in) and the resident set replayed. Hang recovery replays
+//the same set, so deltas survive a reset.
+#include <unordered_map>
+
+namespace fenome {
+
+bool kmer_key_from_string(const char* kmer, int32_t kmer_length, struct kmer_key* key) {
+    key->high = 0;
+    key->low  = 0;
+    for (int32_t i = 0; i < kmer_length; i++) {
+        uint64_t code;
+        switch (kmer[i] & 0xdf) {
+            case 'A' : code = 0; break;
+            case 'C' : code = 1; break;
+            case 'G' : code = 2; break;
+            case 'T' : code = 3; break;
+            default  : return false;
+        }
+        key->high = (key->high << 2) | (key->low >> 62);
+        key->low  = (key->low << 2) | code;
+    }
+    return true;
+}
+
+static void kmer_key_to_string(const struct kmer_key* key, int32_t kmer_length, char* kmer) {
+    static const char bases[4] = {'A', 'C', 'G', 'T'};
+    uint64_t high = key->high, low = key->low;
+    for (int32_t i = kmer_length - 1; i >= 0; i--) {
+        kmer[i] = bases[low & 3];
+        low  = (low >> 2) | (high << 62);
+        high = high >> 2;
+    }
+}
+
+//Count one more copy of a k-mer - false if its counters are already saturated
+static bool resident_kmers_add(struct resident_kmers* resident, const struct kmer_key& key) {
+    uint8_t& count = resident->counts[key];
+    if (count >= CBF_COUNTER_MAX) {
+        return false;
+    }
+    if (count == 0 && resident->num_retired > 0 && resident->retired_pending.erase(key)) {
+        resident->num_retired--;                     //Retired and added back before the filter was rebuilt
+    }
+    if (++count == CBF_COUNTER_MAX) {
+        resident->num_saturated++;
+    }
+    return true;
+}
+
+static void resident_kmers_add_padding(struct resident_kmers* resident, const struct kmer_key& first, uint32_t num_kmers) {
+    for (uint32_t i = num_kmers; i % 8 != 0; i++) {
+        resident_kmers_add(resident, first);
+    }
+}
+
+void resident_kmers_add_padding(struct resident_kmers* resident, const std::string& first_kmer, uint32_t num_kmers) {
+    struct kmer_key key;
+    if (kmer_key_from_string(first_kmer.c_str(), resident->kmer_length, &key)) {
+        resident_kmers_add_padding(resident, key, num_kmers);
+    }
+}
+
+void resident_kmers_init(struct resident_kmers* resident, int32_t kmer_length) {
+    resident->kmer_length   = kmer_length;
+    resident->num_saturated = 0;
+    resident->num_retired   = 0;
+    resident->counts.clear();
+    resident->retired_pending.clear();
+}
+
+//Account the k-mers of the file the filter was programmed from, skipping the lines fenome.cpp skipped
+bool resident_kmers_load(struct resident_kmers* resident, const std::string& kmer_file_name) {
+    std::ifstream kmer_file(kmer_file_name.c_str());
+    std::string kmer_string;
+    struct kmer_key key;
+    if (!kmer_file.is_open()) {
+        return false;
+    }
+    while (std::getline(kmer_file, kmer_string)) {
+        if (((int32_t) kmer_string.length() >= resident->kmer_length) && kmer_key_from_string(kmer_string.c_str(), resident->kmer_length, &key)) {
+            resident_kmers_add(resident, key);
+        }
+    }
+    return true;
+}
+
+//Program the counts of the resident set into a cleared filter. Pass n programs every k-mer with a count of at
+//least n, so copies of one k-mer never share a batch. Padding copies are counted once every pass is done, so
+//they don't make a later pass program their k-mer again.
+bool replay_resident_kmers(struct recovery_state* recovery) {
+    struct resident_kmers* resident = recovery->resident_kmers;
+    struct host_kernels kernels;
+    struct afu_batch batch;
+    char kmer[MAX_KMER_LENGTH + 1];
+    uint64_t num_kmers = 0;
+    struct kmer_key first;
+    std::vector<std::pair<struct kmer_key, uint32_t>> padded_batches;
+
+    if (!recovery->kmer_space || !select_host_kernels(&kernels, resident->kmer_length, MAX_READ_LENGTH)) {
+        return false;
+    }
+    batch.mode        = PROGRAM;
+    batch.read_space  = recovery->kmer_space;
+    batch.write_space = NULL;
+    batch.num_items   = 0;
+
+    for (int32_t pass = 1; pass <= CBF_COUNTER_MAX; pass++) {
+        for (auto entry = resident->counts.begin(); entry != resident->counts.end(); ++entry) {
+            if (entry->second < pass) continue;
+            if (batch.num_items == 0) first = entry->first;
+            kmer_key_to_string(&entry->first, resident->kmer_length, kmer);
+            kernels.pack_kmer(recovery->kmer_space + batch.num_items * 64, kmer, resident->kmer_length);
+            if (++batch.num_items == recovery->kmer_space_items) {
+                issue_batch(*recovery->afu, recovery->kmer_length, &batch);
+                if (!wait_for_idle_watchdog(*recovery->afu, recovery->stall_ms)) return false;
+                recovery->afu->clear_status();
+                num_kmers += batch.num_items;
+                padded_batches.push_back(std::make_pair(first, batch.num_items));
+                batch.num_items = 0;
+            }
+        }
+        if (batch.num_items > 0) {
+            issue_batch(*recovery->afu, recovery->kmer_length, &batch);
+            if (!wait_for_idle_watchdog(*recovery->afu, recovery->stall_ms)) return false;
+            recovery->afu->clear_status();
+            num_kmers += batch.num_items;
+            padded_batches.push_back(std::make_pair(first, batch.num_items));
+            batch.num_items = 0;
+        }
+    }
+    for (uint32_t b = 0; b < padded_batches.size(); b++) {
+        resident_kmers_add_padding(resident, padded_batches[b].first, padded_batches[b].second);
+    }
+    std::cout << "Replayed " << num_kmers << " k-mer copies into the Bloom filter" << std::endl;
+    return true;
+}
+
+//Clear the filter and replay the resident set, dropping the retired k-mers for good
+bool rebuild_filter(struct recovery_state* recovery) {
+    device& afu = *recovery->afu;
+    struct resident_kmers* resident = recovery->resident_kmers;
+    afu.reset();
+    if (!wait_for_idle_watchdog(afu, recovery->stall_ms)) {
+        std::cout << "ERROR! AFU doesn't come back after reset" << std::endl;
+        return false;
+    }
+    afu.clear_status();
+    if (!wait_for_ddr3_init(afu)) {
+        std::cout << "ERROR! Cannot clear the Bloom filter memory" << std::endl;
+        return false;
+    }
+    afu.clear_status();
+    for (auto key = resident->retired_pending.begin(); key != resident->retired_pending.end(); ++key) {
+        resident->counts.erase(*key);
+    }
+    resident->retired_pending.clear();
+    resident->num_retired = 0;
+    return replay_resident_kmers(recovery);
+}
+
+//Program a batch of delta k-mers and wait for it
+static bool program_delta_batch(fenome::accelerator* accelerator, char* kmer_space, uint32_t num_kmers) {
+    fenome::batch batch;
+    batch.mode        = fenome::afu_mode::program;
+    batch.num_items   = num_kmers;
+    batch.read_space  = kmer_space;
+    batch.write_space = NULL;
+    return accelerator->submit(batch).get().success;
+}
+
+int32_t apply_kmer_delta(fenome::accelerator* accelerator, struct resident_kmers* resident, const struct host_kernels* kernels, const std::string& add_file_name, const std::string& remove_file_name, struct kmer_delta_statistics* statistics) {
+    std::string kmer_string;
+    struct kmer_key key, first;
+    uint32_t num_kmers_in_batch = 0;
+    char* kmer_space = (char*) accelerator->allocate_buffer(KMER_DELTA_KMERS_PER_ITERATION * 64);
+    if (!kmer_space) {
+        std::cout << "ERROR!!! Cannot allocate space for k-mer deltas" << std::endl;
+        return -1;
+    }
+    memset(statistics, 0, sizeof(struct kmer_delta_statistics));
+
+    //Removals first, so a k-mer that is removed and re-added in one delta ends up resident
+    if (!remove_file_name.empty()) {
+        std::ifstream remove_file(remove_file_name.c_str());
+        if (!remove_file.is_open()) {
+            std::cout << "Cannot open k-mer removal file " << remove_file_name << std::endl;
+        }
+        while (std::getline(remove_file, kmer_string)) {
+            if (((int32_t) kmer_string.length() < resident->kmer_length) || !kmer_key_from_string(kmer_string.c_str(), resident->kmer_length, &key)) {
+                statistics->num_invalid++;
+                continue;
+            }
+            auto entry = resident->counts.find(key);
+            if ((entry == resident->counts.end()) || (entry->second == 0)) {
+                statistics->num_not_resident++;
+                continue;
+            }
+            if (entry->second == CBF_COUNTER_MAX) {
+                resident->num_saturated--;
+            }
+            statistics->num_removed++;
+            if (--entry->second == 0) {
+                resident->retired_pending.insert(key);
+                resident->num_retired++;
+            }
+        }
+    }
+
+    if (!add_file_name.empty()) {
+        std::ifstream add_file(add_file_name.c_str());
+        if (!add_file.is_open()) {
+            std::cout << "Cannot open k-mer addition file " << add_file_name << std::endl;
+        }
+        while (std::getline(add_file, kmer_string)) {
+            if (((int32_t) kmer_string.length() < resident->kmer_length) || !kmer_key_from_string(kmer_string.c_str(), resident->kmer_length, &key)) {
+                statistics->num_invalid++;
+                continue;
+            }
+            if (!resident_kmers_add(resident, key)) {
+                statistics->num_saturated++;
+                continue;
+            }
+            if (num_kmers_in_batch == 0) first = key;
+            kernels->pack_kmer(kmer_space + num_kmers_in_batch * 64, kmer_string.c_str(), resident->kmer_length);
+            statistics->num_added++;
+            if (++num_kmers_in_batch == KMER_DELTA_KMERS_PER_ITERATION) {
+                if (!program_delta_batch(accelerator, kmer_space, num_kmers_in_batch)) {
+                    fenome::accelerator::release_buffer(kmer_space);
+                    return -1;
+                }
+                num_kmers_in_batch = 0;
+            }
+        }
+        if (num_kmers_in_batch > 0) {
+            if (!program_delta_batch(accelerator, kmer_space, num_kmers_in_batch)) {
+                fenome::accelerator::release_buffer(kmer_space);
+                return -1;
+            }
+            resident_kmers_add_padding(resident, first, num_kmers_in_batch);
+        }
+    }
+    fenome::accelerator::release_buffer(kmer_space);
+
+    //Retired k-mers still test positive until the filter is rebuilt
+    if (resident->num_retired > KMER_DELTA_REBUILD_FRACTION * resident->counts.size()) {
+        std::cout << "Rebuilding the Bloom filter to drop " << resident->num_retired << " retired k-mers" << std::endl;
+        if (!accelerator->rebuild_filter().get().success) return -1;
+        statistics->rebuilt = true;
+    }
+    return 0;
+}
+
+void print_kmer_delta_statistics(const struct resident_kmers* resident, const struct kmer_delta_statistics* statistics) {
+    std::cout << "k-mer delta : " << statistics->num_added << " added, " << statistics->num_removed << " removed, "
+              << statistics->num_saturated << " already saturated, " << statistics->num_not_resident << " removals not resident, "
+              << statistics->num_invalid << " invalid" << (statistics->rebuilt ? " - filter rebuilt" : "") << std::endl;
+    std::cout << "Resident k-mers : " << resident->counts.size() - resident->num_retired << ", " << resident->num_saturated
+              << " at the counter limit of " << CBF_COUNTER_MAX << ", " << resident->num_retired << " retired but still in the filter" << std::endl;
+}
+
+}
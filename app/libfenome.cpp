@@ -0,0 +1,209 @@
+//libfenome implementation - the device, the register operations, hang recovery, telemetry, NUMA placement and
+//k-mer deltas. Everything fenome.cpp links against lives in namespace fenome.
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "libfenome.hpp"
+#include "fenome.hpp"
+#include "register_operations.cpp"
+#include "host_kernels.cpp"
+#include "telemetry.cpp"
+#include "recovery.cpp"
+#include "numa.cpp"
+#include "kmer_delta.cpp"
+
+namespace fenome {
+
+device::device(uint64_t wed, const std::string& path) : afu_h(NULL) {
+    if (!path.empty()) {
+        afu_h = cxl_afu_open_dev((char*) path.c_str());
+    } else {
+        struct cxl_afu_h* afu = cxl_afu_next(NULL);
+        if (!afu) {
+            throw device_error("No AFU found!!!");
+        }
+        afu_h = cxl_afu_open_h(afu, CXL_VIEW_DEDICATED);
+    }
+    if (!afu_h) {
+        throw device_error("Cannot open AFU!!!");
+    }
+    cxl_afu_attach(afu_h, wed);
+    if (cxl_mmio_map(afu_h, CXL_MMIO_LITTLE_ENDIAN) < 0) {
+        cxl_afu_free(afu_h);
+        throw device_error("Cannot map MMIO!!!");
+    }
+}
+
+device::~device() {
+    cxl_mmio_unmap(afu_h);
+    cxl_afu_free(afu_h);
+}
+
+uint32_t device::read32(afu_register reg) const {
+    uint32_t val;
+    cxl_mmio_read32(afu_h, (uint64_t) reg, &val);
+    return val;
+}
+
+uint64_t device::read64(afu_register reg) const {
+    uint64_t val;
+    cxl_mmio_read64(afu_h, (uint64_t) reg, &val);
+    return val;
+}
+
+void device::write32(afu_register reg, uint32_t value) {
+    cxl_mmio_write32(afu_h, (uint64_t) reg, value);
+}
+
+void device::write64(afu_register reg, uint64_t value) {
+    cxl_mmio_write64(afu_h, (uint64_t) reg, value);
+}
+
+void device::start() {
+    write32(afu_register::start, 0xdead);
+}
+
+void device::reset() {
+    write32(afu_register::reset, 0xdead);
+}
+
+void device::clear_status() {
+    write32(afu_register::status, 0x0);
+}
+
+bool device::idle() const {
+    return (read32(afu_register::status) & 0x43) == 0x43;      //PLL LOCK, local_init_done, status = 1
+}
+
+bool device::wait_for_idle() {
+    int32_t total_wait_cycles = (2 << 25);
+    for (int32_t num_wait_cycles = 0; num_wait_cycles < total_wait_cycles; num_wait_cycles++) {
+        if (idle()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+accelerator::accelerator(int32_t kmer_length, const std::string& kmer_file_name, uint64_t wed, const std::string& device_path) : dev(wed, device_path), recovery_(new struct recovery_state), telemetry_(NULL), stopping(false) {
+    recovery_init(recovery_.get(), &dev, kmer_length, kmer_file_name);
+    numa_node_ = afu_numa_node(dev.handle());
+    if (numa_node_ >= 0 && numa_num_nodes() > 1) {
+        std::cout << "AFU is attached to NUMA node " << numa_node_ << std::endl;
+    }
+    thread = std::thread(&accelerator::worker, this);
+}
+
+accelerator::~accelerator() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    thread.join();
+    free(recovery_->kmer_space);
+}
+
+std::future<batch_result> accelerator::submit(const batch& work) {
+    queued_batch item;
+    item.work    = work;
+    item.rebuild = false;
+    std::future<batch_result> result = item.promise.get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(std::move(item));
+    }
+    ready.notify_one();
+    return result;
+}
+
+std::future<batch_result> accelerator::rebuild_filter() {
+    queued_batch item;
+    item.work.mode        = afu_mode::program;
+    item.work.num_items   = 0;
+    item.work.read_space  = NULL;
+    item.work.write_space = NULL;
+    item.rebuild          = true;
+    std::future<batch_result> result = item.promise.get_future();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(std::move(item));
+    }
+    ready.notify_one();
+    return result;
+}
+
+void accelerator::track_kmers(struct resident_kmers* resident) {
+    std::lock_guard<std::mutex> guard(lock);
+    recovery_->resident_kmers = resident;
+}
+
+size_t accelerator::pending() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return queue.size();
+}
+
+void accelerator::attach_telemetry(struct telemetry_state* telemetry) {
+    struct telemetry_counters* counters = telemetry_register_thread(telemetry, "accelerator");
+    std::lock_guard<std::mutex> guard(lock);
+    telemetry_ = counters;
+}
+
+void* accelerator::allocate_buffer(size_t bytes) {
+    return numa_alloc_on_node(bytes, numa_node_);
+}
+
+void accelerator::release_buffer(void* space) {
+    free(space);
+}
+
+bool accelerator::pin_to_card() {
+    return pin_thread_to_node(numa_node_);
+}
+
+//Batches run one at a time and in submission order; the queue lets the caller fill the next buffers meanwhile
+void accelerator::worker() {
+    pin_thread_to_node(numa_node_);
+    while (true) {
+        queued_batch item;
+        struct telemetry_counters* counters;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            item = std::move(queue.front());
+            queue.pop_front();
+            counters = telemetry_;
+            telemetry_set_queue_depth(counters, queue.size());
+        }
+
+        batch_result result;
+        uint64_t start_time = telemetry_now_ns();
+        int32_t num_skipped;
+        if (item.rebuild) {
+            num_skipped = (recovery_->resident_kmers && fenome::rebuild_filter(recovery_.get())) ? 0 : -1;
+        } else {
+            struct afu_batch work;
+            work.mode        = (uint32_t) item.work.mode;
+            work.num_items   = item.work.num_items;
+            work.read_space  = item.work.read_space;
+            work.write_space = item.work.write_space;
+            work.threshold   = item.work.threshold;
+            memcpy(work.levels, item.work.levels, sizeof(work.levels));
+            num_skipped = run_batch(recovery_.get(), &work);
+        }
+        result.device_ns   = telemetry_now_ns() - start_time;
+        telemetry_add_stage(counters, STAGE_DEVICE, result.device_ns);
+        if (!item.rebuild) {
+            telemetry_add_batch(counters, (uint32_t) item.work.mode, item.work.num_items, result.device_ns);
+        }
+        result.success     = (num_skipped >= 0);
+        result.num_items   = item.work.num_items;
+        result.num_skipped = (num_skipped > 0) ? num_skipped : 0;
+        result.write_space = item.work.write_space;
+        item.promise.set_value(result);
+    }
+}
+
+}
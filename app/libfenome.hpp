@@ -0,0 +1,153 @@
+//libfenome - in-process interface to the fenome AFU, for tools that want to correct reads without
+//spawning fenome and exchanging text files. Build the shared library with
+//    g++ -std=c++11 -O2 -fPIC -shared libfenome.cpp -lcxl -lpthread -o libfenome.so
+//and link fenome and ddr3_test against it with
+//    g++ -std=c++11 -O2 fenome.cpp -L. -lfenome -lcxl -lpthread -o fenome
+//    g++ -std=c++11 -O2 ddr3_test.cpp -L. -lfenome -lcxl -lpthread -o ddr3_test
+#ifndef LIBFENOME_HPP
+#define LIBFENOME_HPP
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+struct cxl_afu_h;
+struct recovery_state;
+struct resident_kmers;
+struct telemetry_state;
+struct telemetry_counters;
+
+namespace fenome {
+
+//MMIO registers of the AFU as byte offsets - see pslMMIO.v
+enum class afu_register : uint64_t {
+    control        = 0x2 << 2,
+    threshold      = 0x3 << 2,
+    read_base      = 0x4 << 2,
+    write_base     = 0x6 << 2,
+    reads_received = 0x8 << 2,
+    reads_written  = 0x9 << 2,
+    num_items      = 0xa << 2,
+    start          = 0x10 << 2,
+    reset          = 0x20 << 2,
+    status         = 0x30 << 2,
+    ddr3_base      = 0x40 << 2
+};
+
+enum class afu_mode : uint32_t {
+    program       = 0,
+    solid_islands = 1,
+    correction    = 2,
+    ddr3_init     = 4,
+    ddr3_read     = 5,
+    ddr3_write    = 6
+};
+
+class device_error : public std::runtime_error {
+public:
+    explicit device_error(const std::string& what) : std::runtime_error(what) {}
+};
+
+//An open, attached AFU with its MMIO space mapped. Closed when the object goes away.
+//The wed is handed to cxl_afu_attach, but pslControl.v only latches it at Start and nothing in psl/ reads it,
+//so every batch is still programmed over MMIO. A descriptor ring behind the WED needs descriptor fetch and
+//completion posting in the RTL first.
+class device {
+public:
+    explicit device(uint64_t wed = 0, const std::string& path = "");   //path selects a card, e.g. /dev/cxl/afu1.0d
+    ~device();
+    device(const device&) = delete;
+    device& operator=(const device&) = delete;
+
+    uint32_t read32(afu_register reg) const;
+    uint64_t read64(afu_register reg) const;
+    void     write32(afu_register reg, uint32_t value);
+    void     write64(afu_register reg, uint64_t value);
+
+    void start();
+    void reset();
+    void clear_status();
+    bool idle() const;
+    bool wait_for_idle();
+
+    struct cxl_afu_h* handle() const { return afu_h; }
+
+private:
+    struct cxl_afu_h* afu_h;
+};
+
+//A batch of work. The buffers belong to the caller: they must be 128-byte aligned, laid out as fenome.hpp
+//describes for the mode, and left alone until the batch's future is ready. The AFU reads and writes them in place.
+struct batch {
+    afu_mode mode;
+    uint32_t num_items;
+    char*    read_space;
+    char*    write_space;                            //Unused for afu_mode::program
+    uint8_t  threshold;
+    uint8_t  levels[4];
+};
+
+struct batch_result {
+    bool     success;                                //False if the AFU was lost - the device is unusable after this
+    uint32_t num_items;
+    uint32_t num_skipped;                            //Items that hung the AFU and were returned empty
+    uint64_t device_ns;
+    char*    write_space;
+};
+
+//Queue of batches run in order by a submission thread, with hang recovery. The thread is pinned to the card's NUMA node.
+//k-mers programmed through submit() are replayed from kmer_file_name if the AFU has to be reset.
+class accelerator {
+public:
+    accelerator(int32_t kmer_length, const std::string& kmer_file_name, uint64_t wed = 0, const std::string& device_path = "");
+    ~accelerator();
+    accelerator(const accelerator&) = delete;
+    accelerator& operator=(const accelerator&) = delete;
+
+    std::future<batch_result> submit(const batch& work);
+    std::future<batch_result> rebuild_filter();      //Clear the filter and replay the tracked k-mers, in queue order
+    void track_kmers(struct resident_kmers* resident);
+                                                     //Restore the filter from resident instead of kmer_file_name from now on
+    size_t pending() const;
+    void attach_telemetry(struct telemetry_state* telemetry);
+                                                     //Account the worker's device time, batches and pending() as a thread of its own
+
+    //Buffers on the card's NUMA node, for batches - release with accelerator::release_buffer
+    void* allocate_buffer(size_t bytes);
+    static void release_buffer(void* space);
+    int32_t numa_node() const { return numa_node_; }
+    bool pin_to_card();                              //Pin the calling thread to the card's node
+
+    device& afu() { return dev; }
+    const struct recovery_state& recovery() const { return *recovery_; }
+
+private:
+    void worker();
+
+    device dev;
+    std::unique_ptr<struct recovery_state> recovery_;
+    int32_t numa_node_;
+    struct telemetry_counters* telemetry_;
+    struct queued_batch {
+        batch work;
+        bool  rebuild;
+        std::promise<batch_result> promise;
+    };
+
+    std::deque<queued_batch> queue;
+    mutable std::mutex lock;
+    std::condition_variable ready;
+    bool stopping;
+    std::thread thread;
+};
+
+}
+
+#endif
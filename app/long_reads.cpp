@@ -0,0 +1,279 @@
+//Long reads. The item format keeps the length in one byte and the correction units are built for reads up to
+//MAX_READ_LENGTH, so a read longer than the run's read length is split into windows of that length which
+//overlap by a k-mer and go through the batches as ordinary items. A window's item carries the read's island
+//coordinates moved into the window. The stimulus only describes the first non-solid region, so the windows
+//past it are profiled with SOLID_ISLANDS first, as the correction rounds do, and carry the coordinates of
+//their own first non-solid island. Windows before the region and windows the profile finds solid are not
+//sent at all. Once every window is back the corrections are stitched together: each window owns the bases
+//up to the middle of its overlaps, and an overlap base the two windows corrected differently keeps the read's
+//base. Only the stitched read is written out and counted; its windows get no records of their own.
+
+void long_reads_init(struct long_reads* long_reads, int32_t window_length, int32_t kmer_length, uint32_t capacity) {
+    long_reads->window_length = window_length;
+    long_reads->overlap       = std::min(kmer_length, window_length - 1);
+    long_reads->kmer_length   = kmer_length;
+    long_reads->first_id      = 0;
+    long_reads->reads.clear();
+    long_reads->slot_read.assign(capacity, -1);
+    long_reads->slot_window.assign(capacity, 0);
+    long_reads->profile_space            = NULL;
+    long_reads->index_space              = NULL;
+    long_reads->profile_space_items      = 0;
+    long_reads->index_space_items        = 0;
+    long_reads->num_reads                = 0;
+    long_reads->num_windows              = 0;
+    long_reads->num_windows_profiled     = 0;
+    long_reads->num_windows_skipped      = 0;
+    long_reads->num_conflicts            = 0;
+    long_reads->num_reads_with_conflicts = 0;
+}
+
+void long_reads_reserve(struct long_reads* long_reads, uint32_t capacity) {
+    if (capacity <= long_reads->slot_read.size()) return;
+    long_reads->slot_read.resize(capacity, -1);
+    long_reads->slot_window.resize(capacity, 0);
+}
+
+void long_reads_free(struct long_reads* long_reads) {
+    fenome::accelerator::release_buffer(long_reads->profile_space);
+    fenome::accelerator::release_buffer(long_reads->index_space);
+}
+
+//What the read's coordinates tell about a window
+enum window_kind {
+    WINDOW_SOLID,                                    //Within the solid island the read starts with
+    WINDOW_KNOWN,                                    //Overlaps the region, the coordinates are set
+    WINDOW_UNPROFILED                                //Past the region - nothing is known about it
+};
+
+//Coordinates of the window at offset for a read with the given ones, in k-mer positions as classify_read_islands
+//produces them
+static enum window_kind window_coordinates(int32_t start_position, int32_t end_position, int32_t read_length, int32_t offset, int32_t window_length, int32_t kmer_length, int32_t* window_start, int32_t* window_end) {
+    int32_t num_window_kmers = window_length - kmer_length + 1;
+    int32_t start = start_position - offset;
+    int32_t end   = end_position - offset;
+
+    //Unless a case below knows better, the window has no solid k-mer
+    *window_start = 0;
+    *window_end   = window_length - 1;
+    if (end_position == 0) {                         //FIVE_PRIME - non-solid up to k-mer start_position
+        if (start < 0) {
+            return WINDOW_UNPROFILED;
+        }
+        if (start < num_window_kmers - 1) {
+            *window_start = start;
+            *window_end   = 0;
+        }
+        return WINDOW_KNOWN;
+    }
+    if ((start_position == 0) && (end_position >= read_length - 1)) {
+        return WINDOW_KNOWN;                         //NO_SOLID
+    }
+    if (start >= num_window_kmers) {
+        return WINDOW_SOLID;
+    }
+    if (end_position < read_length - 1) {            //BETWEEN - solid before start_position and after end_position
+        if (end + 1 >= num_window_kmers) {
+            if (start > 0) *window_start = start;
+        } else if (end >= 0 && start <= 0) {
+            *window_start = end;
+            *window_end   = 0;
+        } else if (start > 0) {
+            *window_start = start;
+            *window_end   = end;
+        } else {
+            return WINDOW_UNPROFILED;
+        }
+        return WINDOW_KNOWN;
+    }
+    if (start > 0) {                                 //THREE_PRIME - non-solid from start_position on
+        *window_start = start;
+    }
+    return WINDOW_KNOWN;
+}
+
+//Profile the windows of a read nothing is known about and take their coordinates from the profile. A window
+//that turns out to be solid is not sent.
+static bool profile_windows(struct long_reads* long_reads, fenome::accelerator* accelerator, const struct host_kernels* kernels, struct long_read* entry, const std::vector<uint32_t>& unprofiled) {
+    uint32_t num_items = unprofiled.size() + (unprofiled.size() % 2);
+    long_reads->profile_space = batch_buffer_reserve(accelerator, long_reads->profile_space, &long_reads->profile_space_items, num_items, 256);
+    long_reads->index_space   = batch_buffer_reserve(accelerator, long_reads->index_space, &long_reads->index_space_items, num_items, 256);
+    if (!long_reads->profile_space || !long_reads->index_space) {
+        std::cout << "ERROR!!! Cannot allocate space to profile long read windows" << std::endl;
+        return false;
+    }
+    for (uint32_t i = 0; i < unprofiled.size(); i++) {
+        const struct long_read_window& window = entry->windows[unprofiled[i]];
+        kernels->pack_profile(long_reads->profile_space + (uint64_t) i * 256, entry->read.c_str() + window.offset, long_reads->window_length);
+    }
+    //SOLID_ISLANDS runs reads in pairs - an odd batch takes one more item, so make it a harmless copy
+    if (unprofiled.size() % 2 != 0) {
+        memcpy(long_reads->profile_space + unprofiled.size() * 256, long_reads->profile_space, 256);
+    }
+
+    fenome::batch profile_batch;
+    profile_batch.mode        = fenome::afu_mode::solid_islands;
+    profile_batch.num_items   = unprofiled.size();
+    profile_batch.read_space  = long_reads->profile_space;
+    profile_batch.write_space = long_reads->index_space;
+    if (!accelerator->submit(profile_batch).get().success) {
+        return false;
+    }
+    long_reads->num_windows_profiled += unprofiled.size();
+
+    for (uint32_t i = 0; i < unprofiled.size(); i++) {
+        struct long_read_window& window = entry->windows[unprofiled[i]];
+        const int32_t* index_base = (const int32_t*) (long_reads->index_space + (uint64_t) i * 256);
+        if (classify_read_islands(index_base, long_reads->window_length, long_reads->kmer_length, &window.start_position, &window.end_position) == SOLID_READ) {
+            window.submitted = false;
+            window.corrected = entry->read.substr(window.offset, long_reads->window_length);
+            entry->num_received++;
+            long_reads->num_windows_skipped++;
+        }
+    }
+    return true;
+}
+
+bool long_reads_add(struct long_reads* long_reads, fenome::accelerator* accelerator, const struct host_kernels* kernels, const std::string& read, const std::string& quality, int32_t start_position, int32_t end_position) {
+    int32_t read_length   = (int32_t) read.length();
+    int32_t window_length = long_reads->window_length;
+    int32_t step          = window_length - long_reads->overlap;
+    std::vector<uint32_t> unprofiled;
+    struct long_read entry;
+    entry.read         = read;
+    entry.quality      = quality;
+    entry.next_window  = 0;
+    entry.num_received = 0;
+    for (int32_t offset = 0; ; offset += step) {
+        struct long_read_window window;
+        window.offset = std::min(offset, read_length - window_length);
+        enum window_kind kind = window_coordinates(start_position, end_position, read_length, window.offset, window_length, long_reads->kmer_length, &window.start_position, &window.end_position);
+        window.submitted = (kind != WINDOW_SOLID);
+        if (kind == WINDOW_SOLID) {
+            window.corrected = read.substr(window.offset, window_length);
+            entry.num_received++;
+            long_reads->num_windows_skipped++;
+        } else if (kind == WINDOW_UNPROFILED) {
+            unprofiled.push_back(entry.windows.size());
+        }
+        entry.windows.push_back(window);
+        if (window.offset + window_length >= read_length) break;
+    }
+    if (!unprofiled.empty() && !profile_windows(long_reads, accelerator, kernels, &entry, unprofiled)) {
+        return false;
+    }
+    long_reads->num_reads++;
+    long_reads->num_windows += entry.windows.size();
+    long_reads->reads.push_back(entry);
+
+    //Solid windows are never packed, so move past them now - a read whose every window is solid is already complete
+    struct long_read& last = long_reads->reads.back();
+    while ((last.next_window < last.windows.size()) && !last.windows[last.next_window].submitted) {
+        last.next_window++;
+    }
+    return true;
+}
+
+bool long_reads_pending(const struct long_reads* long_reads) {
+    if (long_reads->reads.empty()) {
+        return false;
+    }
+    const struct long_read& last = long_reads->reads.back();
+    return last.next_window < last.windows.size();
+}
+
+void long_reads_pack_next(struct long_reads* long_reads, const struct host_kernels* kernels, const char* quality, char* read_item, uint32_t slot) {
+    struct long_read& last = long_reads->reads.back();
+    const struct long_read_window& window = last.windows[last.next_window];
+    if (!last.quality.empty()) {
+        quality = last.quality.c_str() + window.offset;
+    }
+    kernels->pack_read(read_item, last.read.c_str() + window.offset, quality, long_reads->window_length);
+    read_item[254] = window.start_position;
+    read_item[253] = window.end_position;
+    long_reads->slot_read[slot]   = long_reads->first_id + long_reads->reads.size() - 1;
+    long_reads->slot_window[slot] = last.next_window;
+    do {
+        last.next_window++;
+    } while ((last.next_window < last.windows.size()) && !last.windows[last.next_window].submitted);
+}
+
+//Each window owns its bases up to the middle of the overlap with the next one
+static std::string stitch_long_read(const struct long_read* entry, int32_t window_length, uint32_t* num_conflicts) {
+    std::string stitched = entry->read;
+    int32_t own_begin = 0;
+    *num_conflicts = 0;
+    for (uint32_t w = 0; w < entry->windows.size(); w++) {
+        const struct long_read_window& window = entry->windows[w];
+        int32_t own_end = (int32_t) entry->read.length();
+        if (w + 1 < entry->windows.size()) {
+            const struct long_read_window& next = entry->windows[w + 1];
+            own_end = (next.offset + window.offset + window_length) / 2;
+            for (int32_t i = next.offset; i < window.offset + window_length; i++) {
+                if (window.corrected[i - window.offset] != next.corrected[i - next.offset]) {
+                    (*num_conflicts)++;
+                }
+            }
+        }
+        for (int32_t i = own_begin; i < own_end; i++) {
+            stitched[i] = window.corrected[i - window.offset];
+        }
+        own_begin = own_end;
+    }
+    if (*num_conflicts == 0) {
+        return stitched;
+    }
+    for (uint32_t w = 0; w + 1 < entry->windows.size(); w++) {
+        const struct long_read_window& window = entry->windows[w];
+        const struct long_read_window& next   = entry->windows[w + 1];
+        for (int32_t i = next.offset; i < window.offset + window_length; i++) {
+            if (window.corrected[i - window.offset] != next.corrected[i - next.offset]) {
+                stitched[i] = entry->read[i];
+            }
+        }
+    }
+    return stitched;
+}
+
+//Long reads complete in input order, since their windows are packed in input order
+uint32_t long_reads_complete_batch(struct long_reads* long_reads, const char* composed_space, const char* candidate_space, const uint32_t* position, uint32_t num_items, const struct host_kernels* kernels, bool rounds_applied, FILE* output) {
+    int32_t window_length = long_reads->window_length;
+    uint32_t num_completed = 0;
+    for (uint32_t m = 0; m < num_items; m++) {
+        if (long_reads->slot_read[m] < 0) continue;
+        uint32_t p = position[m];
+        const char* read_item = composed_space + (uint64_t) p * 512;
+        const char* corrected = read_item;
+        if (!rounds_applied) {
+            const char* candidate_local_space = candidate_space + (uint64_t) p * 256 * 32;
+            int32_t best_candidate = choose_candidate(candidate_local_space, read_item, window_length, kernels);
+            if (best_candidate >= 0) {
+                corrected = candidate_local_space + best_candidate * 256;
+            }
+        }
+        struct long_read& entry = long_reads->reads[long_reads->slot_read[m] - long_reads->first_id];
+        entry.windows[long_reads->slot_window[m]].corrected.assign(corrected, window_length);
+        entry.num_received++;
+        long_reads->slot_read[m] = -1;
+    }
+
+    while (!long_reads->reads.empty()) {
+        const struct long_read& entry = long_reads->reads.front();
+        if ((entry.next_window < entry.windows.size()) || (entry.num_received < entry.windows.size())) break;
+        uint32_t num_conflicts;
+        std::string stitched = stitch_long_read(&entry, window_length, &num_conflicts);
+        fprintf(output, "Stitched:%s:%s:%u\n", entry.read.c_str(), stitched.c_str(), num_conflicts);
+        long_reads->num_conflicts            += num_conflicts;
+        long_reads->num_reads_with_conflicts += (num_conflicts > 0);
+        long_reads->reads.pop_front();
+        long_reads->first_id++;
+        num_completed++;
+    }
+    return num_completed;
+}
+
+void print_long_read_statistics(const struct long_reads* long_reads) {
+    std::cout << "Long reads : " << long_reads->num_reads << " split into " << long_reads->num_windows << " windows of " << long_reads->window_length
+              << " bases (" << long_reads->num_windows_profiled << " profiled, " << long_reads->num_windows_skipped << " solid, not sent), " << long_reads->num_conflicts << " overlap conflicts in "
+              << long_reads->num_reads_with_conflicts << " reads" << std::endl;
+}
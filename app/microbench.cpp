@@ -0,0 +1,289 @@
+//Microbenchmarks of the host-side hot kernels, each in isolation on synthetic data, so the stage that would
+//bound a run at device speed can be found without a card or the libcxl headers:
+//    g++ -std=c++11 -O2 microbench.cpp -lpthread -o microbench
+//Every kernel runs at several batch sizes and thread counts; threads work on private copies of the data.
+//Reported are ns per read (wall time over all threads), bytes per cycle per thread and the speedup over one thread.
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "host_kernels.hpp"
+#include "host_kernels.cpp"
+#include "error_correction.cpp"
+
+#define BENCH_MIN_NS 20000000                        //Repeat a kernel until one thread has run this long
+#define BENCH_TRIALS 3                               //Best of
+
+struct bench_data {
+    std::vector<std::string> reads;
+    std::vector<std::string> qualities;
+    std::vector<std::string> kmers;                  //Four per read, like num_kmers_per_iteration
+    std::string fastq;
+    char* read_space;
+    char* kmer_space;
+    char* candidate_space;
+    FILE* output;
+    uint32_t checksum;                               //Keeps the compiler from dropping results
+};
+
+struct bench_kernel {
+    const char* name;
+    uint64_t (*run)(struct bench_data* data, const struct host_kernels* kernels, uint32_t num_reads);
+                                                     //Returns the bytes consumed
+};
+
+static uint64_t bench_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+//Page aligned and pre-faulted, like the buffers handed to the AFU - release with free()
+static char* bench_alloc(size_t bytes) {
+    void* space;
+    if (posix_memalign(&space, sysconf(_SC_PAGESIZE), bytes) != 0) {
+        std::cout << "ERROR!!! Cannot allocate " << bytes << " bytes" << std::endl;
+        exit(-1);
+    }
+    memset(space, 0, bytes);
+    return (char*) space;
+}
+
+static uint32_t bench_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t) (*state >> 32);
+}
+
+//Reads with a low-quality stretch in the middle, as in fenome.cpp, and up to 32 candidates each with a few substitutions
+static void bench_data_init(struct bench_data* data, uint32_t num_reads, int32_t read_length, int32_t kmer_length, uint64_t seed) {
+    static const char bases[4] = {'A', 'C', 'G', 'T'};
+    uint64_t state = seed;
+    std::stringstream fastq;
+    data->read_space      = bench_alloc((uint64_t) num_reads * 512);
+    data->kmer_space      = bench_alloc((uint64_t) num_reads * 4 * 64);
+    data->candidate_space = bench_alloc((uint64_t) num_reads * 256 * 32);
+    data->output          = fopen("/dev/null", "w");
+    data->checksum        = 0;
+    setvbuf(data->output, NULL, _IOFBF, 1 << 20);
+
+    for (uint32_t m = 0; m < num_reads; m++) {
+        std::string read(read_length, 'A'), quality(read_length, 'I');
+        for (int32_t i = 0; i < read_length; i++) {
+            read[i] = bases[bench_random(&state) & 3];
+            if ((i >= 40) && (i < 70)) quality[i] = '#';
+        }
+        data->reads.push_back(read);
+        data->qualities.push_back(quality);
+        for (int32_t k = 0; k < 4; k++) {
+            data->kmers.push_back(read.substr(bench_random(&state) % (read_length - kmer_length + 1), kmer_length));
+        }
+        fastq << "@read" << m << "\n" << read << "\n+\n" << quality << "\n";
+
+        char* read_item = data->read_space + (uint64_t) m * 512;
+        memcpy(read_item, read.c_str(), read_length);
+        read_item[255] = read_length;
+        char* candidate_local_space = data->candidate_space + (uint64_t) m * 256 * 32;
+        int32_t num_candidates = bench_random(&state) % 33;
+        for (int32_t n = 0; n < num_candidates; n++) {
+            char* candidate = candidate_local_space + n * 256;
+            memcpy(candidate, read.c_str(), read_length);
+            for (uint32_t s = bench_random(&state) % 4; s > 0; s--) {
+                candidate[bench_random(&state) % read_length] = bases[bench_random(&state) & 3];
+            }
+            candidate[255] = num_candidates;
+        }
+        candidate_local_space[255] = num_candidates;
+    }
+    data->fastq = fastq.str();
+}
+
+static void bench_data_free(struct bench_data* data) {
+    free(data->read_space);
+    free(data->kmer_space);
+    free(data->candidate_space);
+    fclose(data->output);
+}
+
+//FASTQ records into 512-byte correction items, line by line as the input loops read them
+static uint64_t bench_parse_fastq(struct bench_data* data, const struct host_kernels* kernels, uint32_t num_reads) {
+    std::istringstream input(data->fastq);
+    std::string line_id, read_string, line_misc, quality_string;
+    uint32_t m = 0;
+    while ((m < num_reads) && std::getline(input, line_id) && std::getline(input, read_string) && std::getline(input, line_misc) && std::getline(input, quality_string)) {
+        int32_t read_length = std::min((int32_t) read_string.length(), kernels->read_length);
+        data->checksum += kernels->pack_read(data->read_space + (uint64_t) m * 512, read_string.c_str(), quality_string.c_str(), read_length);
+        m++;
+    }
+    return data->fastq.size();
+}
+
+static uint64_t bench_pack_kmers(struct bench_data* data, const struct host_kernels* kernels, uint32_t num_reads) {
+    for (uint32_t k = 0; k < num_reads * 4; k++) {
+        data->checksum += kernels->pack_kmer(data->kmer_space + (uint64_t) k * 64, data->kmers[k].c_str(), kernels->kmer_length);
+    }
+    return (uint64_t) num_reads * 4 * kernels->kmer_length;
+}
+
+static uint64_t bench_pack_reads(struct bench_data* data, const struct host_kernels* kernels, uint32_t num_reads) {
+    for (uint32_t m = 0; m < num_reads; m++) {
+        data->checksum += kernels->pack_read(data->read_space + (uint64_t) m * 512, data->reads[m].c_str(), data->qualities[m].c_str(), (int32_t) data->reads[m].length());
+    }
+    return (uint64_t) num_reads * 2 * kernels->read_length;
+}
+
+static uint64_t bench_scan_candidates(struct bench_data* data, const struct host_kernels* kernels, uint32_t num_reads) {
+    uint64_t num_bytes = 0;
+    for (uint32_t m = 0; m < num_reads; m++) {
+        const char* candidate_local_space = data->candidate_space + (uint64_t) m * 256 * 32;
+        const char* read = data->read_space + (uint64_t) m * 512;
+        data->checksum += choose_candidate(candidate_local_space, read, (uint8_t) read[255], kernels);
+        num_bytes += (uint64_t) (uint8_t) candidate_local_space[255] * (uint8_t) read[255];
+    }
+    return num_bytes;
+}
+
+//The per-read lines fenome.cpp writes for a correction batch
+static uint64_t bench_format_output(struct bench_data* data, const struct host_kernels*, uint32_t num_reads) {
+    uint64_t num_bytes = 0;
+    for (uint32_t m = 0; m < num_reads; m++) {
+        char* candidate_local_space = data->candidate_space + (uint64_t) m * 256 * 32;
+        const char* read = data->reads[m].c_str();
+        int32_t read_length = (int32_t) data->reads[m].length();
+        int32_t num_candidates = (uint8_t) candidate_local_space[255];
+        num_bytes += fprintf(data->output, "Candidate for %.*s is at %lu\n", read_length, read, (uint64_t) candidate_local_space);
+        num_bytes += fprintf(data->output, "Read %.*s has %d candidates\n", read_length, read, num_candidates);
+        for (int32_t n = 0; n < num_candidates; n++) {
+            char* candidate = candidate_local_space + n * 256;
+            num_bytes += fprintf(data->output, "Read:%.*s:%.*s:%d\n", read_length, read, read_length, candidate, (int32_t) candidate[255]);
+        }
+    }
+    return num_bytes;
+}
+
+static const struct bench_kernel bench_kernels[] = {
+    {"parse_fastq",     bench_parse_fastq},
+    {"pack_kmers",      bench_pack_kmers},
+    {"pack_reads",      bench_pack_reads},
+    {"scan_candidates", bench_scan_candidates},
+    {"format_output",   bench_format_output}
+};
+
+//Nominal core clock from /proc/cpuinfo - "cpu MHz" on x86, "clock" on POWER
+static double bench_cpu_ghz() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if ((line.compare(0, 7, "cpu MHz") == 0) || (line.compare(0, 5, "clock") == 0)) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                double mhz = atof(line.c_str() + colon + 1);
+                if (mhz > 0) return mhz / 1000;
+            }
+        }
+    }
+    return 0;
+}
+
+//Run a kernel on every thread's data at once, repetitions times - wall time in ns, bytes per repetition and thread
+static uint64_t bench_run(const struct bench_kernel* kernel, std::vector<struct bench_data>& data, const struct host_kernels* kernels, uint32_t num_threads, uint32_t num_reads, uint32_t repetitions, uint64_t* num_bytes) {
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> num_ready(0);
+    std::atomic<bool> go(false);
+    uint64_t start_time = 0;
+    for (uint32_t t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            num_ready++;
+            while (!go.load()) std::this_thread::yield();
+            for (uint32_t r = 0; r < repetitions; r++) {
+                uint64_t bytes = kernel->run(&data[t], kernels, num_reads);
+                if (t == 0) *num_bytes = bytes;
+            }
+        }));
+    }
+    while (num_ready.load() != num_threads) std::this_thread::yield();
+    start_time = bench_now_ns();
+    go = true;
+    for (uint32_t t = 0; t < num_threads; t++) {
+        threads[t].join();
+    }
+    return bench_now_ns() - start_time;
+}
+
+int main(int argc, char** argv) {
+    int32_t read_length = 112;
+    int32_t kmer_length = 30;
+    uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    double cpu_ghz = bench_cpu_ghz();
+    std::vector<uint32_t> batch_sizes = {512, 2048, 8192};
+    struct host_kernels kernels;
+    int option;
+
+    while ((option = getopt(argc, argv, "k:r:t:f:")) != -1) {
+        switch (option) {
+            case 'k' : kmer_length = atoi(optarg); break;
+            case 'r' : read_length = atoi(optarg); break;
+            case 't' : max_threads = std::max(atoi(optarg), 1); break;
+            case 'f' : cpu_ghz = atof(optarg); break;
+            default :
+                std::cout << "Usage: " << argv[0] << " [-k kmer_length] [-r read_length] [-t max_threads] [-f cpu_ghz]" << std::endl;
+                return -1;
+        }
+    }
+    if (!fenome::select_host_kernels(&kernels, kmer_length, read_length)) {
+        return -1;
+    }
+    if (cpu_ghz <= 0) {
+        std::cout << "WARNING! Cannot tell the CPU clock, bytes/cycle assumes 1 GHz - pass -f" << std::endl;
+        cpu_ghz = 1;
+    }
+    std::vector<uint32_t> thread_counts;
+    for (uint32_t n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    std::cout << "read_length " << read_length << ", kmer_length " << kmer_length << ", " << cpu_ghz << " GHz, up to " << max_threads << " threads" << std::endl;
+    printf("%-16s %8s %8s %12s %12s %10s\n", "kernel", "batch", "threads", "ns/read", "bytes/cycle", "speedup");
+    for (uint32_t b = 0; b < batch_sizes.size(); b++) {
+        uint32_t num_reads = batch_sizes[b];
+        std::vector<struct bench_data> data(max_threads);
+        for (uint32_t t = 0; t < max_threads; t++) {
+            bench_data_init(&data[t], num_reads, read_length, kmer_length, 0x9e3779b97f4a7c15ull + t);
+        }
+        for (uint32_t k = 0; k < sizeof(bench_kernels) / sizeof(bench_kernels[0]); k++) {
+            const struct bench_kernel* kernel = &bench_kernels[k];
+            uint64_t num_bytes = 0;
+            //Size the repetitions on one thread, so every thread count does the same work per thread
+            uint64_t single_ns = std::max(bench_run(kernel, data, &kernels, 1, num_reads, 1, &num_bytes), (uint64_t) 1);
+            uint32_t repetitions = (uint32_t) std::max((uint64_t) 1, BENCH_MIN_NS / single_ns);
+            double single_ns_per_read = 0;
+            for (uint32_t n = 0; n < thread_counts.size(); n++) {
+                uint32_t num_threads = thread_counts[n];
+                uint64_t best_ns = ~0ull;
+                for (int32_t trial = 0; trial < BENCH_TRIALS; trial++) {
+                    best_ns = std::min(best_ns, bench_run(kernel, data, &kernels, num_threads, num_reads, repetitions, &num_bytes));
+                }
+                double ns_per_read = (double) best_ns / ((double) repetitions * num_reads * num_threads);
+                double bytes_per_cycle = (double) num_bytes * repetitions / (best_ns * cpu_ghz);
+                if (num_threads == 1) single_ns_per_read = ns_per_read;
+                printf("%-16s %8u %8u %12.2f %12.3f %10.2f\n", kernel->name, num_reads, num_threads, ns_per_read, bytes_per_cycle, single_ns_per_read / ns_per_read);
+            }
+        }
+        uint32_t checksum = 0;
+        for (uint32_t t = 0; t < max_threads; t++) {
+            checksum += data[t].checksum;
+            bench_data_free(&data[t]);
+        }
+        if (checksum == 0x5eed) std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+//NUMA placement relative to the CAPI slot. The card's node comes from the PCI device in sysfs, buffers
+//the AFU reads and writes are bound to that node and the threads driving the AFU are pinned to its CPUs.
+//Only sysfs and the raw mbind syscall are used, so there is no dependency on libnuma.
+//Parsing and post-processing are deliberately not spread across sockets. They run on the main thread in
+//input order, which the output order and the byte-offset checkpoints rely on, and every buffer they fill
+//or read is one the AFU touches, so it lives on the card's node - a worker on the other socket would only
+//move that traffic onto the interconnect.
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#define MPOL_PREFERRED 1
+
+namespace fenome {
+
+//Parse a sysfs cpu/node list such as "0-7,16-23"
+static void parse_sysfs_list(const std::string& list, std::vector<int32_t>& values) {
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        int32_t first, last;
+        if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2) {
+            for (int32_t i = first; i <= last; i++) values.push_back(i);
+        } else if (sscanf(range.c_str(), "%d", &first) == 1) {
+            values.push_back(first);
+        }
+    }
+}
+
+int32_t afu_numa_node(struct cxl_afu_h* afu_h) {
+    char* pci_path = NULL;
+    int32_t node = -1;
+    if (cxl_afu_sysfs_pci(afu_h, &pci_path) < 0 || !pci_path) {
+        return -1;
+    }
+    std::ifstream node_file((std::string(pci_path) + "/numa_node").c_str());
+    if (!(node_file >> node)) {
+        node = -1;
+    }
+    free(pci_path);
+    return node;                                     //-1 also when the platform has a single node
+}
+
+int32_t numa_num_nodes() {
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string list;
+    std::vector<int32_t> nodes;
+    if (!std::getline(online, list)) return 1;
+    parse_sysfs_list(list, nodes);
+    return nodes.empty() ? 1 : nodes.back() + 1;
+}
+
+bool numa_node_cpus(int32_t node, cpu_set_t* cpus) {
+    std::stringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream cpu_file(path.str().c_str());
+    std::string list;
+    std::vector<int32_t> cpu_list;
+    if (!std::getline(cpu_file, list)) return false;
+    parse_sysfs_list(list, cpu_list);
+    CPU_ZERO(cpus);
+    for (size_t i = 0; i < cpu_list.size(); i++) {
+        CPU_SET(cpu_list[i], cpus);
+    }
+    return !cpu_list.empty();
+}
+
+bool pin_thread_to_node(int32_t node) {
+    cpu_set_t cpus;
+    if (node < 0 || !numa_node_cpus(node, &cpus)) return false;
+    return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+}
+
+//Page aligned (which covers the AFU's 128-byte requirement), preferred on the node, and touched here so the pages exist before the AFU sees them
+void* numa_alloc_on_node(size_t bytes, int32_t node) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t length    = ((bytes + page_size - 1) / page_size) * page_size;
+    void* space;
+    if (posix_memalign(&space, page_size, length) != 0) {
+        return NULL;
+    }
+    if (node >= 0) {
+        unsigned long node_mask[16] = {0};
+        if (node < (int32_t) (sizeof(node_mask) * 8)) {
+            node_mask[node / (sizeof(unsigned long) * 8)] |= 1ul << (node % (sizeof(unsigned long) * 8));
+            if (syscall(SYS_mbind, space, length, MPOL_PREFERRED, node_mask, sizeof(node_mask) * 8, 0) != 0) {
+                std::cout << "WARNING! Cannot bind buffer to NUMA node " << node << std::endl;
+            }
+        }
+    }
+    memset(space, 0, length);
+    return space;
+}
+
+}
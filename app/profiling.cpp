@@ -0,0 +1,261 @@
+//Profiling-only mode. Reads are streamed through SOLID_ISLANDS with two sets of buffers, so one batch is packed
+//while the other is on the AFU, and every read produces one island record in the output:
+//    uint8 read_length, uint8 num_islands, then num_islands x (uint8 first k-mer, uint8 number of solid k-mers)
+//Records carry no header and follow input order, so shard outputs can be concatenated. Reads shorter than a
+//k-mer get a record with no islands. Reads longer than the run's read length are profiled as overlapping windows,
+//the way long reads are corrected, and their islands merged back into read coordinates. A record can't describe
+//more than MAX_READ_LENGTH bases, so longer reads are cut there and counted. QC metrics for the whole run are
+//written as JSON at the end.
+#include <future>
+
+//Items a read occupies in a batch - windows overlap by a k-mer less one base, so every k-mer lies whole in one
+struct profile_read {
+    uint32_t first_item;
+    uint32_t num_windows;
+    int32_t  read_length;
+};
+
+static uint32_t profile_num_windows(int32_t read_length, const struct host_kernels* kernels) {
+    int32_t step = kernels->read_length - kernels->kmer_length + 1;
+    if (read_length <= kernels->read_length) return 1;
+    return 1 + (read_length - kernels->read_length + step - 1) / step;
+}
+
+static int32_t profile_window_offset(uint32_t window, int32_t read_length, const struct host_kernels* kernels) {
+    int32_t step = kernels->read_length - kernels->kmer_length + 1;
+    return std::max(std::min((int32_t) window * step, read_length - kernels->read_length), 0);
+}
+
+//Merge the islands of a windowed read's items into one index in read coordinates, in the AFU's format
+static void merge_window_islands(const char* write_space, const struct profile_read* entry, const struct host_kernels* kernels, int32_t* index_base) {
+    bool solid[MAX_READ_LENGTH] = {false};
+    int32_t num_kmers = entry->read_length - kernels->kmer_length + 1;
+    int32_t num_islands = 0;
+    for (uint32_t w = 0; w < entry->num_windows; w++) {
+        const int32_t* window_index = (const int32_t*) (write_space + (uint64_t) (entry->first_item + w) * 256);
+        int32_t offset = profile_window_offset(w, entry->read_length, kernels);
+        for (int32_t n = 0; (n < 32) && (window_index[2 * n] != -1); n++) {
+            for (int32_t i = window_index[2 * n]; (i < window_index[2 * n] + window_index[2 * n + 1]) && (offset + i < num_kmers); i++) {
+                solid[offset + i] = true;
+            }
+        }
+    }
+    for (int32_t i = 0; (i < num_kmers) && (num_islands < 32);) {
+        if (!solid[i]) {
+            i++;
+            continue;
+        }
+        index_base[2 * num_islands] = i;
+        while ((i < num_kmers) && solid[i]) i++;
+        index_base[2 * num_islands + 1] = i - index_base[2 * num_islands];
+        num_islands++;
+    }
+    index_base[2 * num_islands] = -1;
+}
+
+//Next read of a FASTQ file or of a file with one read (plus optional fields) per line
+static bool next_profile_read(std::ifstream& input, std::string& read) {
+    std::string line;
+    if (!std::getline(input, line)) return false;
+    if (!line.empty() && (line[0] == '@')) {
+        std::string separator, quality;
+        return std::getline(input, read) && std::getline(input, separator) && std::getline(input, quality);
+    }
+    std::stringstream fields(line);
+    read.clear();
+    fields >> read;
+    return true;
+}
+
+//Build a read's island record at record and account it in the QC metrics - returns the record's size
+static uint32_t build_profile_record(uint8_t* record, struct profile_qc* qc, struct correction_counters* counters, const int32_t* index_base, int32_t read_length, int32_t kmer_length) {
+    int32_t num_islands = 0;
+    int32_t num_solid_bases = 0;
+    int32_t covered_until = 0;
+
+    qc->reads++;
+    qc->bases += read_length;
+    for (int32_t i = 0; i < read_length; i++) {
+        qc->bases_by_cycle[i]++;
+    }
+    if (read_length >= kmer_length) {
+        //A base is solid if any solid k-mer covers it
+        for (; (num_islands < 32) && (index_base[2 * num_islands] != -1); num_islands++) {
+            int32_t first_kmer = index_base[2 * num_islands];
+            int32_t num_kmers  = index_base[2 * num_islands + 1];
+            record[2 + 2 * num_islands]     = first_kmer;
+            record[2 + 2 * num_islands + 1] = num_kmers;
+            int32_t first_base = std::max(first_kmer, covered_until);
+            int32_t last_base  = std::min(first_kmer + num_kmers + kmer_length - 1, read_length);
+            for (int32_t i = covered_until; i < first_base; i++) {
+                qc->non_solid_by_cycle[i]++;
+            }
+            num_solid_bases += std::max(last_base - first_base, 0);
+            covered_until = std::max(covered_until, last_base);
+        }
+        correction_report_add_profile(counters, index_base, read_length, kmer_length);
+    } else {
+        qc->reads_too_short++;
+    }
+    for (int32_t i = covered_until; i < read_length; i++) {
+        qc->non_solid_by_cycle[i]++;
+    }
+    qc->solid_bases += num_solid_bases;
+    if (num_islands == 0) {
+        qc->reads_no_solid += (read_length >= kmer_length);
+    } else if (num_solid_bases == read_length) {
+        qc->reads_fully_solid++;
+    }
+    qc->islands_per_read[num_islands]++;
+
+    record[0] = read_length;
+    record[1] = num_islands;
+    return 2 + 2 * num_islands;
+}
+
+bool profile_qc_write(const struct profile_qc* qc, const std::string& qc_file_name) {
+    FILE* qc_file = fopen(qc_file_name.c_str(), "w");
+    if (!qc_file) {
+        std::cout << "WARNING! Cannot write QC metrics " << qc_file_name << std::endl;
+        return false;
+    }
+    int32_t num_cycles = MAX_READ_LENGTH;
+    while ((num_cycles > 0) && (qc->bases_by_cycle[num_cycles - 1] == 0)) num_cycles--;
+
+    fprintf(qc_file, "{\n");
+    fprintf(qc_file, "  \"reads\": %lu,\n", (unsigned long) qc->reads);
+    fprintf(qc_file, "  \"reads_no_solid_kmer\": %lu,\n", (unsigned long) qc->reads_no_solid);
+    fprintf(qc_file, "  \"reads_fully_solid\": %lu,\n", (unsigned long) qc->reads_fully_solid);
+    fprintf(qc_file, "  \"reads_shorter_than_kmer\": %lu,\n", (unsigned long) qc->reads_too_short);
+    fprintf(qc_file, "  \"reads_windowed\": %lu,\n", (unsigned long) qc->reads_windowed);
+    fprintf(qc_file, "  \"reads_truncated\": %lu,\n", (unsigned long) qc->reads_truncated);
+    fprintf(qc_file, "  \"solid_base_fraction\": %.6f,\n", qc->bases ? (double) qc->solid_bases / qc->bases : 0.0);
+    fprintf(qc_file, "  \"islands_per_read\": [");
+    for (int32_t i = 0; i <= 32; i++) {
+        fprintf(qc_file, "%s%lu", i ? ", " : "", (unsigned long) qc->islands_per_read[i]);
+    }
+    fprintf(qc_file, "],\n  \"non_solid_rate_by_cycle\": [");
+    for (int32_t i = 0; i < num_cycles; i++) {
+        fprintf(qc_file, "%s%.6f", i ? ", " : "", qc->bases_by_cycle[i] ? (double) qc->non_solid_by_cycle[i] / qc->bases_by_cycle[i] : 0.0);
+    }
+    fprintf(qc_file, "]\n}\n");
+    fclose(qc_file);
+    return true;
+}
+
+int32_t run_profiling(fenome::accelerator* accelerator, const struct host_kernels* kernels, std::ifstream& input, struct run_checkpoint* checkpoint, const std::string& checkpoint_file_name, FILE* output, struct profile_qc* qc, struct correction_counters* counters, struct telemetry_counters* telemetry) {
+    uint32_t num_reads_per_iteration = PROFILE_READS_PER_ITERATION;
+    fenome::batch batch[2];
+    std::future<fenome::batch_result> result[2];
+    uint64_t input_offset[2];
+    uint32_t current = 0;
+    uint32_t num_items_in_batch = 0;
+    uint32_t num_invalid_bases = 0;
+    std::string read_string;
+    std::vector<uint8_t> records((uint64_t) num_reads_per_iteration * (2 + 2 * 32));
+    std::vector<struct profile_read> reads[2];
+    int32_t merged_index[2 * 32 + 1];
+
+    for (int32_t b = 0; b < 2; b++) {
+        batch[b].mode        = fenome::afu_mode::solid_islands;
+        batch[b].num_items   = 0;
+        batch[b].read_space  = (char*) accelerator->allocate_buffer((num_reads_per_iteration + 1) * 256);
+        batch[b].write_space = (char*) accelerator->allocate_buffer((num_reads_per_iteration + 1) * 256);
+        if (!batch[b].read_space || !batch[b].write_space) {
+            std::cout << "ERROR!!! Cannot allocate profiling buffers" << std::endl;
+            return -1;
+        }
+    }
+
+    //Write out a finished batch, one record per read whatever the number of its windows
+    auto complete = [&](uint32_t b) -> bool {
+        fenome::batch_result done = result[b].get();
+        uint64_t post_process_time = fenome::telemetry_now_ns();
+        if (!done.success) return false;
+        uint64_t records_size = 0;
+        for (uint32_t r = 0; r < reads[b].size(); r++) {
+            const struct profile_read* entry = &reads[b][r];
+            const int32_t* index_base = (const int32_t*) (batch[b].write_space + (uint64_t) entry->first_item * 256);
+            if (entry->num_windows > 1) {
+                merge_window_islands(batch[b].write_space, entry, kernels, merged_index);
+                index_base = merged_index;
+            }
+            records_size += build_profile_record(&records[records_size], qc, counters, index_base, entry->read_length, kernels->kmer_length);
+        }
+        uint64_t output_time = fenome::telemetry_now_ns();
+        fenome::telemetry_add_stage(telemetry, STAGE_POST_PROCESS, output_time - post_process_time);
+        fwrite(records.data(), 1, records_size, output);
+        checkpoint->batches_completed++;
+        checkpoint->reads_processed += reads[b].size();
+        reads[b].clear();
+        if (!checkpoint_file_name.empty() && (checkpoint->batches_completed % CHECKPOINT_INTERVAL_BATCHES == 0)) {
+            checkpoint_commit(checkpoint_file_name, checkpoint, output, input_offset[b]);
+        }
+        fenome::telemetry_add_stage(telemetry, STAGE_OUTPUT, fenome::telemetry_now_ns() - output_time);
+        return true;
+    };
+
+    //Hand the filled buffers, which cover the input up to end_offset, to the AFU and wait for the other set,
+    //which is then free to be filled
+    auto submit = [&](uint64_t end_offset) -> bool {
+        //SOLID_ISLANDS runs reads in pairs - an odd batch takes one more item, so make it a harmless copy
+        if (num_items_in_batch % 2 != 0) {
+            memcpy(batch[current].read_space + num_items_in_batch * 256, batch[current].read_space, 256);
+        }
+        batch[current].num_items = num_items_in_batch;
+        input_offset[current]    = end_offset;
+        result[current]          = accelerator->submit(batch[current]);
+        current ^= 1;
+        num_items_in_batch = 0;
+        return !result[current].valid() || complete(current);
+    };
+
+    uint64_t stage_time = fenome::telemetry_now_ns();
+    uint64_t read_offset;
+    while (((read_offset = (uint64_t) input.tellg()) < checkpoint->input_end) && next_profile_read(input, read_string)) {
+        int32_t read_length = (int32_t) read_string.length();
+        if (read_length > MAX_READ_LENGTH) {
+            read_length = MAX_READ_LENGTH;
+            qc->reads_truncated++;
+        }
+        uint32_t num_windows = profile_num_windows(read_length, kernels);
+        qc->reads_windowed += (num_windows > 1);
+
+        //A read's windows go into one batch - the input offset of a batch must not split a read
+        if (num_items_in_batch + num_windows > num_reads_per_iteration) {
+            fenome::telemetry_add_stage(telemetry, STAGE_PARSE, fenome::telemetry_now_ns() - stage_time);
+            if (!submit(read_offset)) return -1;
+            stage_time = fenome::telemetry_now_ns();
+        }
+        struct profile_read entry = {num_items_in_batch, num_windows, read_length};
+        for (uint32_t w = 0; w < num_windows; w++) {
+            int32_t offset = profile_window_offset(w, read_length, kernels);
+            num_invalid_bases += kernels->pack_profile(batch[current].read_space + num_items_in_batch * 256, read_string.c_str() + offset, std::min(read_length, kernels->read_length));
+            num_items_in_batch++;
+        }
+        reads[current].push_back(entry);
+    }
+    if (num_items_in_batch != 0) {
+        fenome::telemetry_add_stage(telemetry, STAGE_PARSE, fenome::telemetry_now_ns() - stage_time);
+        if (!submit(input.eof() ? checkpoint->input_end : (uint64_t) input.tellg())) return -1;
+    }
+    current ^= 1;
+    if (result[current].valid() && !complete(current)) return -1;
+
+    for (int32_t b = 0; b < 2; b++) {
+        fenome::accelerator::release_buffer(batch[b].read_space);
+        fenome::accelerator::release_buffer(batch[b].write_space);
+    }
+    if (num_invalid_bases > 0) {
+        std::cout << "WARNING! " << num_invalid_bases << " bases were not ACGT - the AFU profiles them as A" << std::endl;
+    }
+    if (qc->reads_windowed > 0) {
+        std::cout << "Profiled " << qc->reads_windowed << " reads longer than " << kernels->read_length << " bases as overlapping windows" << std::endl;
+    }
+    if (qc->reads_truncated > 0) {
+        std::cout << "WARNING! " << qc->reads_truncated << " reads are longer than " << MAX_READ_LENGTH << " bases - their records cover the first " << MAX_READ_LENGTH << " only" << std::endl;
+    }
+    std::cout << "Profiled " << qc->reads << " reads : " << 100.0 * qc->solid_bases / std::max(qc->bases, (uint64_t) 1) << "% solid bases, "
+              << qc->reads_no_solid << " reads without a solid k-mer" << std::endl;
+    return 0;
+}
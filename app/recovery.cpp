@@ -0,0 +1,196 @@
+//Hang detection and recovery. A batch that stops making progress (READS_RECEIVED and READS_WRITTEN frozen)
+//is abandoned, the AFU is reset, the Bloom filter is re-programmed and only that batch is re-issued.
+//A batch that keeps hanging is bisected down to the offending items, which are reported and skipped.
+#include <fstream>
+
+namespace fenome {
+
+//Bytes between consecutive items in the buffers handed to the AFU
+static uint32_t batch_read_stride(uint32_t mode) {
+    return (mode == CORRECTION) ? 512 : (mode == SOLID_ISLANDS) ? 256 : 64;
+}
+
+static uint32_t batch_write_stride(uint32_t mode) {
+    return (mode == CORRECTION) ? 256 * 32 : (mode == SOLID_ISLANDS) ? 256 : 0;
+}
+
+bool inline wait_for_idle_watchdog(device& afu, uint32_t stall_ms) {
+    uint32_t reads_received, reads_written;
+    uint32_t last_received = 0xffffffff, last_written = 0xffffffff;
+    uint64_t last_progress = telemetry_now_ns();
+    uint64_t num_polls = 0;
+    while (true) {
+        if (afu.idle()) {
+            return true;
+        }
+        if (++num_polls % WATCHDOG_POLL_INTERVAL != 0) continue;
+
+        reads_received = afu.read32(afu_register::reads_received);
+        reads_written  = afu.read32(afu_register::reads_written);
+        uint64_t now = telemetry_now_ns();
+        if ((reads_received != last_received) || (reads_written != last_written)) {
+            last_received = reads_received;
+            last_written  = reads_written;
+            last_progress = now;
+        } else if (now - last_progress > (uint64_t) stall_ms * 1000000) {
+            return false;
+        }
+    }
+}
+
+void inline issue_batch(device& afu, int32_t kmer_length, struct afu_batch* batch) {
+    switch (batch->mode) {
+        case PROGRAM :
+            set_kmer_program_mode(afu, batch->num_items, kmer_length, batch->read_space);
+            break;
+        case SOLID_ISLANDS :
+            set_read_profile_mode(afu, batch->num_items, kmer_length, (int32_t*) batch->write_space, batch->read_space);
+            break;
+        case CORRECTION :
+            set_read_correct_mode(afu, batch->num_items, batch->threshold, kmer_length, batch->levels[0], batch->levels[1], batch->levels[2], batch->levels[3], batch->write_space, batch->read_space);
+            break;
+    }
+    afu.start();
+}
+
+void recovery_init(struct recovery_state* recovery, device* afu, int32_t kmer_length, const std::string& kmer_file_name) {
+    recovery->afu                     = afu;
+    recovery->kmer_length             = kmer_length;
+    recovery->kmer_file_name          = kmer_file_name;
+    recovery->num_kmers_programmed    = 0;
+    recovery->kmer_space_items        = RECOVERY_KMERS_PER_ITERATION;
+    recovery->restore_filter_on_reset = true;
+    recovery->resident_kmers          = NULL;
+    recovery->stall_ms                = WATCHDOG_STALL_MS;
+    recovery->max_retries             = RECOVERY_MAX_RETRIES;
+    recovery->num_hangs               = 0;
+    recovery->num_resets              = 0;
+    recovery->num_bad_items           = 0;
+    if (posix_memalign((void**)&recovery->kmer_space, 128, recovery->kmer_space_items * 64) != 0) {
+        std::cout << "ERROR!!! Cannot allocate k-mer space for recovery" << std::endl;
+        recovery->kmer_space = NULL;
+    }
+}
+
+//Replay the k-mers that were in the filter before the reset
+bool restore_filter(struct recovery_state* recovery) {
+    std::ifstream kmer_file(recovery->kmer_file_name.c_str());
+    std::string kmer_string;
+    struct afu_batch batch;
+    struct host_kernels kernels;
+    uint64_t num_kmers = 0;
+    uint32_t num_kmers_in_batch = 0;
+
+    if (recovery->resident_kmers) {
+        return replay_resident_kmers(recovery);
+    }
+    if (!kmer_file.is_open() || !recovery->kmer_space || !select_host_kernels(&kernels, recovery->kmer_length, MAX_READ_LENGTH)) {
+        std::cout << "Cannot restore the Bloom filter from " << recovery->kmer_file_name << std::endl;
+        return false;
+    }
+
+    batch.mode        = PROGRAM;
+    batch.read_space  = recovery->kmer_space;
+    batch.write_space = NULL;
+
+    while ((num_kmers < recovery->num_kmers_programmed) && std::getline(kmer_file, kmer_string)) {
+        //Skip the same lines fenome.cpp skipped when it programmed the filter
+        if (((int32_t) kmer_string.length() < recovery->kmer_length) || !kernels.pack_kmer(recovery->kmer_space + num_kmers_in_batch * 64, kmer_string.c_str(), recovery->kmer_length)) {
+            continue;
+        }
+        num_kmers++;
+        num_kmers_in_batch++;
+        if ((num_kmers_in_batch == recovery->kmer_space_items) || (num_kmers == recovery->num_kmers_programmed)) {
+            batch.num_items = num_kmers_in_batch;
+            issue_batch(*recovery->afu, recovery->kmer_length, &batch);
+            if (!wait_for_idle_watchdog(*recovery->afu, recovery->stall_ms)) {
+                std::cout << "ERROR! AFU hangs while restoring the Bloom filter" << std::endl;
+                return false;
+            }
+            recovery->afu->clear_status();
+            num_kmers_in_batch = 0;
+        }
+    }
+    std::cout << "Restored " << num_kmers << " k-mers into the Bloom filter" << std::endl;
+    return true;
+}
+
+bool reset_afu(struct recovery_state* recovery) {
+    device& afu = *recovery->afu;
+    recovery->num_resets++;
+    std::cout << "Resetting AFU (reset " << recovery->num_resets << ")" << std::endl;
+    afu.reset();
+    if (!wait_for_idle_watchdog(afu, recovery->stall_ms)) {
+        std::cout << "ERROR! AFU doesn't come back after reset" << std::endl;
+        return false;
+    }
+    afu.clear_status();
+    if (recovery->restore_filter_on_reset && (recovery->num_kmers_programmed > 0)) {
+        return restore_filter(recovery);
+    }
+    return true;
+}
+
+//Mark an item the AFU can't process as having produced nothing
+static void mark_bad_item(struct afu_batch* batch, uint32_t item) {
+    if (batch->mode == CORRECTION) {
+        char* candidate_local_space = batch->write_space + item * batch_write_stride(CORRECTION);
+        candidate_local_space[255] = 0;
+    } else if (batch->mode == SOLID_ISLANDS) {
+        memset(batch->write_space + item * batch_write_stride(SOLID_ISLANDS), 0xff, batch_write_stride(SOLID_ISLANDS));
+    }
+}
+
+//Run items [first, first + num_items) of a batch, bisecting on repeated hangs. Returns the number of items given up on or -1.
+static int32_t run_batch_range(struct recovery_state* recovery, struct afu_batch* batch, uint32_t first, uint32_t num_items) {
+    struct afu_batch sub_batch = *batch;
+    sub_batch.num_items   = num_items;
+    sub_batch.read_space  = batch->read_space + (uint64_t) first * batch_read_stride(batch->mode);
+    sub_batch.write_space = batch->write_space ? batch->write_space + (uint64_t) first * batch_write_stride(batch->mode) : NULL;
+
+    for (uint32_t attempt = 0; attempt <= recovery->max_retries; attempt++) {
+        issue_batch(*recovery->afu, recovery->kmer_length, &sub_batch);
+        if (wait_for_idle_watchdog(*recovery->afu, recovery->stall_ms)) {
+            recovery->afu->clear_status();
+            return 0;
+        }
+        recovery->num_hangs++;
+        std::cout << "WARNING! AFU stalled on items " << first << " to " << first + num_items - 1 << " (attempt " << attempt + 1 << ")" << std::endl;
+        if (!reset_afu(recovery)) {
+            return -1;
+        }
+    }
+
+    //k-mers can't be skipped without changing the filter contents
+    if (batch->mode == PROGRAM) {
+        return -1;
+    }
+
+    if (num_items == 1) {
+        std::cout << "WARNING! Giving up on item " << first << " of the batch" << std::endl;
+        mark_bad_item(batch, first);
+        recovery->num_bad_items++;
+        return 1;
+    }
+
+    //Keep the first half even - SOLID_ISLANDS pads odd batches with the next item
+    uint32_t half = num_items / 2;
+    if ((batch->mode == SOLID_ISLANDS) && (half % 2 != 0) && (half > 1)) {
+        half--;
+    }
+    int32_t bad_first = run_batch_range(recovery, batch, first, half);
+    if (bad_first < 0) return -1;
+    int32_t bad_second = run_batch_range(recovery, batch, first + half, num_items - half);
+    if (bad_second < 0) return -1;
+    return bad_first + bad_second;
+}
+
+int32_t run_batch(struct recovery_state* recovery, struct afu_batch* batch) {
+    int32_t num_bad_items = run_batch_range(recovery, batch, 0, batch->num_items);
+    if ((num_bad_items >= 0) && (batch->mode == PROGRAM)) {
+        recovery->num_kmers_programmed += batch->num_items;
+    }
+    return num_bad_items;
+}
+
+}
@@ -0,0 +1,223 @@
+//Run-time telemetry: per-thread counters, a sampler thread that reads the AFU counters and
+//a Prometheus text file that is rewritten every interval. A JSON summary is written at the end.
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+namespace fenome {
+
+static const char* telemetry_stage_names[NUM_STAGES] = {"parse", "device", "post_process", "output"};
+static const char* telemetry_item_names[TELEMETRY_MODES] = {"kmers_programmed", "reads_profiled", "reads_corrected"};
+
+uint64_t telemetry_now_ns() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Only the owning thread writes its counters, so a relaxed load/store is enough and avoids locked RMW ops on the hot path
+static inline void telemetry_bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void telemetry_add_stage(struct telemetry_counters* counters, enum telemetry_stage stage, uint64_t busy_ns) {
+    if (!counters) return;
+    telemetry_bump(counters->stage_busy_ns[stage], busy_ns);
+}
+
+void telemetry_add_batch(struct telemetry_counters* counters, uint32_t mode, uint32_t num_items, uint64_t latency_ns) {
+    if (!counters) return;
+    telemetry_bump(counters->batches, 1);
+    if (mode < TELEMETRY_MODES) {
+        telemetry_bump(counters->items[mode], num_items);
+    }
+    telemetry_bump(counters->batch_latency_ns, latency_ns);
+    if (latency_ns > counters->batch_latency_max_ns.load(std::memory_order_relaxed)) {
+        counters->batch_latency_max_ns.store(latency_ns, std::memory_order_relaxed);
+    }
+    uint64_t latency_us = latency_ns / 1000;
+    int32_t bucket = 0;
+    while ((latency_us >> bucket) > 1 && bucket < TELEMETRY_LATENCY_BUCKETS - 1) {
+        bucket++;
+    }
+    telemetry_bump(counters->batch_latency_histogram[bucket], 1);
+}
+
+void telemetry_set_queue_depth(struct telemetry_counters* counters, int64_t depth) {
+    if (!counters) return;
+    counters->queue_depth.store(depth, std::memory_order_relaxed);
+}
+
+struct telemetry_counters* telemetry_register_thread(struct telemetry_state* telemetry, const char* name) {
+    int32_t slot = telemetry->num_threads.fetch_add(1);
+    if (slot >= TELEMETRY_MAX_THREADS) {
+        std::cout << "WARNING! Out of telemetry slots, thread " << name << " is not tracked" << std::endl;
+        return NULL;
+    }
+    struct telemetry_counters* counters = &telemetry->threads[slot];
+    snprintf(counters->name, sizeof(counters->name), "%s", name);
+    return counters;
+}
+
+static void telemetry_sample_device(struct telemetry_state* telemetry) {
+    const device* afu = telemetry->afu;
+    if (!afu) return;
+    telemetry->status.store(afu->read32(afu_register::status), std::memory_order_relaxed);
+    telemetry->reads_received.store(afu->read32(afu_register::reads_received), std::memory_order_relaxed);
+    telemetry->reads_written.store(afu->read32(afu_register::reads_written), std::memory_order_relaxed);
+    telemetry->num_samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+//Write the metrics to a temporary file and rename it over the old one, so scrapers never see a partial file
+static void telemetry_write_metrics(struct telemetry_state* telemetry) {
+    std::string temp_file_name = telemetry->metrics_file_name + ".tmp";
+    FILE* metrics = fopen(temp_file_name.c_str(), "w");
+    if (!metrics) return;
+
+    int32_t num_threads = std::min((int32_t) telemetry->num_threads.load(), TELEMETRY_MAX_THREADS);
+
+    fprintf(metrics, "# TYPE fenome_uptime_seconds gauge\n");
+    fprintf(metrics, "fenome_uptime_seconds %.3f\n", (telemetry_now_ns() - telemetry->start_time_ns) / 1e9);
+    fprintf(metrics, "# TYPE fenome_afu_status gauge\n");
+    fprintf(metrics, "fenome_afu_status %u\n", telemetry->status.load(std::memory_order_relaxed));
+    fprintf(metrics, "# TYPE fenome_afu_reads_received gauge\n");
+    fprintf(metrics, "fenome_afu_reads_received %u\n", telemetry->reads_received.load(std::memory_order_relaxed));
+    fprintf(metrics, "# TYPE fenome_afu_reads_written gauge\n");
+    fprintf(metrics, "fenome_afu_reads_written %u\n", telemetry->reads_written.load(std::memory_order_relaxed));
+
+    fprintf(metrics, "# TYPE fenome_stage_busy_seconds_total counter\n");
+    for (int t = 0; t < num_threads; t++) {
+        struct telemetry_counters* counters = &telemetry->threads[t];
+        for (int s = 0; s < NUM_STAGES; s++) {
+            fprintf(metrics, "fenome_stage_busy_seconds_total{thread=\"%s\",stage=\"%s\"} %.6f\n", counters->name, telemetry_stage_names[s], counters->stage_busy_ns[s].load(std::memory_order_relaxed) / 1e9);
+        }
+    }
+    fprintf(metrics, "# TYPE fenome_queue_depth gauge\n");
+    for (int t = 0; t < num_threads; t++) {
+        struct telemetry_counters* counters = &telemetry->threads[t];
+        fprintf(metrics, "fenome_queue_depth{thread=\"%s\"} %ld\n", counters->name, (long) counters->queue_depth.load(std::memory_order_relaxed));
+    }
+    fprintf(metrics, "# TYPE fenome_items_total counter\n");
+    for (int t = 0; t < num_threads; t++) {
+        struct telemetry_counters* counters = &telemetry->threads[t];
+        for (int m = 0; m < TELEMETRY_MODES; m++) {
+            fprintf(metrics, "fenome_items_total{thread=\"%s\",kind=\"%s\"} %lu\n", counters->name, telemetry_item_names[m], (unsigned long) counters->items[m].load(std::memory_order_relaxed));
+        }
+    }
+
+    //Batch latency as a Prometheus histogram, merged over all threads
+    uint64_t buckets[TELEMETRY_LATENCY_BUCKETS] = {0};
+    uint64_t num_batches = 0, latency_ns = 0;
+    for (int t = 0; t < num_threads; t++) {
+        struct telemetry_counters* counters = &telemetry->threads[t];
+        for (int b = 0; b < TELEMETRY_LATENCY_BUCKETS; b++) {
+            buckets[b] += counters->batch_latency_histogram[b].load(std::memory_order_relaxed);
+        }
+        num_batches += counters->batches.load(std::memory_order_relaxed);
+        latency_ns  += counters->batch_latency_ns.load(std::memory_order_relaxed);
+    }
+    fprintf(metrics, "# TYPE fenome_batch_latency_seconds histogram\n");
+    uint64_t cumulative = 0;
+    //The last bucket also collects everything slower, so it is only exported as +Inf
+    for (int b = 0; b < TELEMETRY_LATENCY_BUCKETS - 1; b++) {
+        cumulative += buckets[b];
+        fprintf(metrics, "fenome_batch_latency_seconds_bucket{le=\"%g\"} %lu\n", (double) (2ull << b) / 1e6, (unsigned long) cumulative);
+    }
+    fprintf(metrics, "fenome_batch_latency_seconds_bucket{le=\"+Inf\"} %lu\n", (unsigned long) num_batches);
+    fprintf(metrics, "fenome_batch_latency_seconds_sum %.6f\n", latency_ns / 1e9);
+    fprintf(metrics, "fenome_batch_latency_seconds_count %lu\n", (unsigned long) num_batches);
+
+    fclose(metrics);
+    rename(temp_file_name.c_str(), telemetry->metrics_file_name.c_str());
+}
+
+static void telemetry_sampler(struct telemetry_state* telemetry) {
+    while (telemetry->running.load()) {
+        telemetry_sample_device(telemetry);
+        telemetry_write_metrics(telemetry);
+        //Sleep in small steps so that telemetry_stop doesn't wait for a full interval
+        for (uint32_t slept = 0; slept < telemetry->interval_ms && telemetry->running.load(); slept += 10) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+void telemetry_start(struct telemetry_state* telemetry, const device* afu, const std::string& metrics_file_name, const std::string& summary_file_name, uint32_t interval_ms) {
+    telemetry->num_threads       = 0;
+    telemetry->afu               = afu;
+    telemetry->num_samples       = 0;
+    telemetry->metrics_file_name = metrics_file_name;
+    telemetry->summary_file_name = summary_file_name;
+    telemetry->interval_ms       = interval_ms;
+    telemetry->start_time_ns     = telemetry_now_ns();
+    telemetry->running           = true;
+    telemetry->sampler           = std::thread(telemetry_sampler, telemetry);
+}
+
+void telemetry_stop(struct telemetry_state* telemetry) {
+    if (!telemetry->running.exchange(false)) return;
+    telemetry->sampler.join();
+    telemetry_sample_device(telemetry);
+    telemetry_write_metrics(telemetry);
+
+    FILE* summary = fopen(telemetry->summary_file_name.c_str(), "w");
+    if (!summary) {
+        std::cout << "Cannot open " << telemetry->summary_file_name << std::endl;
+        return;
+    }
+
+    int32_t num_threads = std::min((int32_t) telemetry->num_threads.load(), TELEMETRY_MAX_THREADS);
+    double wall_time    = (telemetry_now_ns() - telemetry->start_time_ns) / 1e9;
+    double stage_time[NUM_STAGES] = {0};
+    uint64_t num_items[TELEMETRY_MODES] = {0};
+    uint64_t num_batches = 0, latency_ns = 0, latency_max_ns = 0;
+
+    for (int t = 0; t < num_threads; t++) {
+        struct telemetry_counters* counters = &telemetry->threads[t];
+        for (int s = 0; s < NUM_STAGES; s++) {
+            stage_time[s] += counters->stage_busy_ns[s].load() / 1e9;
+        }
+        num_batches   += counters->batches.load();
+        for (int m = 0; m < TELEMETRY_MODES; m++) {
+            num_items[m] += counters->items[m].load();
+        }
+        latency_ns    += counters->batch_latency_ns.load();
+        latency_max_ns = std::max(latency_max_ns, (uint64_t) counters->batch_latency_max_ns.load());
+    }
+
+    //The device is the bottleneck when it is busy most of the wall time; otherwise whichever host side dominates
+    const char* bottleneck;
+    if (stage_time[STAGE_DEVICE] >= 0.8 * wall_time) {
+        bottleneck = "device";
+    } else if (stage_time[STAGE_PARSE] >= stage_time[STAGE_POST_PROCESS] + stage_time[STAGE_OUTPUT]) {
+        bottleneck = "input";
+    } else {
+        bottleneck = "host";
+    }
+
+    fprintf(summary, "{\n");
+    fprintf(summary, "  \"wall_time_seconds\": %.3f,\n", wall_time);
+    fprintf(summary, "  \"batches\": %lu,\n", (unsigned long) num_batches);
+    //k-mers and reads are different units, so each mode gets its own count and rate
+    fprintf(summary, "  \"items\": {");
+    for (int m = 0; m < TELEMETRY_MODES; m++) {
+        fprintf(summary, "%s\"%s\": %lu", m ? ", " : "", telemetry_item_names[m], (unsigned long) num_items[m]);
+    }
+    fprintf(summary, "},\n  \"items_per_second\": {");
+    for (int m = 0; m < TELEMETRY_MODES; m++) {
+        fprintf(summary, "%s\"%s\": %.1f", m ? ", " : "", telemetry_item_names[m], wall_time > 0 ? num_items[m] / wall_time : 0.0);
+    }
+    fprintf(summary, "},\n");
+    fprintf(summary, "  \"batch_latency_mean_seconds\": %.6f,\n", num_batches ? latency_ns / 1e9 / num_batches : 0.0);
+    fprintf(summary, "  \"batch_latency_max_seconds\": %.6f,\n", latency_max_ns / 1e9);
+    fprintf(summary, "  \"stage_busy_seconds\": {");
+    for (int s = 0; s < NUM_STAGES; s++) {
+        fprintf(summary, "%s\"%s\": %.6f", s ? ", " : "", telemetry_stage_names[s], stage_time[s]);
+    }
+    fprintf(summary, "},\n");
+    fprintf(summary, "  \"afu\": {\"status\": %u, \"reads_received\": %u, \"reads_written\": %u, \"samples\": %lu},\n",
+            telemetry->status.load(), telemetry->reads_received.load(), telemetry->reads_written.load(), (unsigned long) telemetry->num_samples.load());
+    fprintf(summary, "  \"bottleneck\": \"%s\"\n", bottleneck);
+    fprintf(summary, "}\n");
+    fclose(summary);
+}
+
+}
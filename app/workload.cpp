@@ -0,0 +1,129 @@
+//Workload-aware composition of CORRECTION batches. correctErrorsWrapped.v hands reads to its NUM_UNITS engines
+//through a daisy chain that moves on every cycle its input FIFO has data, skips full units and is only reset with
+//the AFU, and results come back in dispatch order, so a run of expensive reads stalls the whole batch. Which unit
+//an item lands on depends on FIFO timing the host can't see. Each read gets a cost estimate from its quality
+//string and island coordinates, and the batch is laid out as if item p went to unit p % NUM_CORRECTION_UNITS,
+//which spreads the expensive reads evenly along the batch. The AFU has no per-unit busy counters, so the
+//utilisation printed is that of this model, not a measurement.
+#include <algorithm>
+
+//2-bit quality as compressQualityScore.v computes it from the four levels
+static inline uint32_t compress_quality(uint8_t score, const uint8_t* levels) {
+    return (score >= levels[3]) ? 3 : (score >= levels[2]) ? 2 : (score >= levels[1]) ? 1 : 0;
+}
+
+//Bases between the island coordinates are walked one k-mer at a time; a low quality base makes findCandidates.v
+//try all four substitutions at once instead of stepping, so it dominates the cost
+uint32_t estimate_correction_cost(const char* read_item, uint8_t threshold, const uint8_t* levels) {
+    const uint8_t* quality = (const uint8_t*) read_item + 256;
+    int32_t read_length    = (uint8_t) read_item[255];
+    int32_t start_position = (uint8_t) read_item[254];
+    int32_t end_position   = (uint8_t) read_item[253];
+    int32_t first, last;
+
+    switch (island_type_from_coordinates(start_position, end_position, read_length)) {
+        case FIVE_PRIME : first = 0;              last = start_position; break;
+        case BETWEEN    : first = start_position; last = end_position;   break;
+        default         : first = start_position; last = read_length;    break;   //THREE_PRIME, or NO_SOLID from 0
+    }
+    last  = std::min(last, read_length);
+    first = std::min(first, last);
+
+    uint32_t num_low_quality = 0;
+    for (int32_t i = first; i < last; i++) {
+        num_low_quality += compress_quality(quality[i], levels) < threshold;
+    }
+    return CORRECTION_COST_BASE + (last - first) + CORRECTION_COST_LOW_QUALITY * num_low_quality;
+}
+
+bool batch_composition_init(struct batch_composition* composition, uint32_t capacity) {
+    composition->capacity = capacity;
+    composition->cost     = new uint32_t[capacity];
+    composition->order    = new uint32_t[capacity];
+    composition->position = new uint32_t[capacity];
+    composition->num_batches           = 0;
+    composition->num_reads             = 0;
+    composition->max_cost              = 0;
+    composition->input_order_busy_sum  = 0;
+    composition->composed_busy_sum     = 0;
+    return true;
+}
+
+void batch_composition_reserve(struct batch_composition* composition, uint32_t capacity) {
+    if (capacity <= composition->capacity) return;
+    batch_composition_free(composition);
+    composition->capacity = capacity;
+    composition->cost     = new uint32_t[capacity];
+    composition->order    = new uint32_t[capacity];
+    composition->position = new uint32_t[capacity];
+}
+
+void batch_composition_free(struct batch_composition* composition) {
+    delete[] composition->cost;
+    delete[] composition->order;
+    delete[] composition->position;
+}
+
+//Fraction of the batch's time the units are busy if item p runs on unit p % NUM_CORRECTION_UNITS
+static double modelled_utilisation(const uint32_t* cost, const uint32_t* order, uint32_t num_reads) {
+    uint64_t load[NUM_CORRECTION_UNITS] = {0};
+    uint64_t total = 0, busiest = 0;
+    for (uint32_t p = 0; p < num_reads; p++) {
+        uint32_t m = order ? order[p] : p;
+        load[p % NUM_CORRECTION_UNITS] += cost[m];
+        total += cost[m];
+    }
+    for (int32_t u = 0; u < NUM_CORRECTION_UNITS; u++) {
+        busiest = std::max(busiest, load[u]);
+    }
+    return busiest ? (double) total / (NUM_CORRECTION_UNITS * busiest) : 1.0;
+}
+
+void compose_correction_batch(struct batch_composition* composition, const char* read_space, char* composed_space, uint32_t num_reads, uint8_t threshold, const uint8_t* levels) {
+    uint32_t* cost  = composition->cost;
+    uint32_t* order = composition->order;
+    uint64_t lane_load[NUM_CORRECTION_UNITS] = {0};
+    uint32_t lane_reads[NUM_CORRECTION_UNITS] = {0};
+    uint32_t lane_capacity[NUM_CORRECTION_UNITS];
+
+    for (uint32_t m = 0; m < num_reads; m++) {
+        cost[m]  = estimate_correction_cost(read_space + (uint64_t) m * 512, threshold, levels);
+        order[m] = m;
+        composition->max_cost = std::max(composition->max_cost, (uint64_t) cost[m]);
+    }
+    composition->input_order_busy_sum += modelled_utilisation(cost, NULL, num_reads);
+
+    //Longest processing time first : the most expensive remaining read goes to the least loaded unit that has a slot left
+    std::stable_sort(order, order + num_reads, [cost](uint32_t a, uint32_t b) { return cost[a] > cost[b]; });
+    for (int32_t u = 0; u < NUM_CORRECTION_UNITS; u++) {
+        lane_capacity[u] = num_reads / NUM_CORRECTION_UNITS + ((uint32_t) u < num_reads % NUM_CORRECTION_UNITS);
+    }
+    for (uint32_t i = 0; i < num_reads; i++) {
+        int32_t lane = -1;
+        for (int32_t u = 0; u < NUM_CORRECTION_UNITS; u++) {
+            if ((lane_reads[u] < lane_capacity[u]) && ((lane < 0) || (lane_load[u] < lane_load[lane]))) {
+                lane = u;
+            }
+        }
+        uint32_t p = lane_reads[lane]++ * NUM_CORRECTION_UNITS + lane;
+        lane_load[lane] += cost[order[i]];
+        composition->position[order[i]] = p;
+    }
+
+    for (uint32_t m = 0; m < num_reads; m++) {
+        uint32_t p = composition->position[m];
+        order[p] = m;
+        memcpy(composed_space + (uint64_t) p * 512, read_space + (uint64_t) m * 512, 512);
+    }
+    composition->composed_busy_sum += modelled_utilisation(cost, order, num_reads);
+    composition->num_batches++;
+    composition->num_reads += num_reads;
+}
+
+void print_batch_composition_statistics(const struct batch_composition* composition) {
+    if (composition->num_batches == 0) return;
+    std::cout << "Modelled correction unit utilisation (item p on unit p % " << NUM_CORRECTION_UNITS << ", not measured) : "
+              << 100.0 * composition->composed_busy_sum / composition->num_batches << "% composed, "
+              << 100.0 * composition->input_order_busy_sum / composition->num_batches << "% in input order over "
+              << composition->num_batches << " batches (max read cost " << composition->max_cost << ")" << std::endl;
+}